@@ -0,0 +1,315 @@
+//   Copyright 2021-2023 libczh - caozhanhao
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+#ifndef LIBCZH_BIND_HPP
+#define LIBCZH_BIND_HPP
+#pragma once
+
+#include "lexer.hpp"
+#include "node.hpp"
+#include "token.hpp"
+#include "value.hpp"
+#include "error.hpp"
+
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+
+#define LIBCZH_BIND_DETAIL_PARENS ()
+#define LIBCZH_BIND_DETAIL_EXPAND(...) LIBCZH_BIND_DETAIL_EXPAND3(LIBCZH_BIND_DETAIL_EXPAND3(LIBCZH_BIND_DETAIL_EXPAND3(__VA_ARGS__)))
+#define LIBCZH_BIND_DETAIL_EXPAND3(...) LIBCZH_BIND_DETAIL_EXPAND2(LIBCZH_BIND_DETAIL_EXPAND2(LIBCZH_BIND_DETAIL_EXPAND2(__VA_ARGS__)))
+#define LIBCZH_BIND_DETAIL_EXPAND2(...) LIBCZH_BIND_DETAIL_EXPAND1(LIBCZH_BIND_DETAIL_EXPAND1(LIBCZH_BIND_DETAIL_EXPAND1(__VA_ARGS__)))
+#define LIBCZH_BIND_DETAIL_EXPAND1(...) __VA_ARGS__
+#define LIBCZH_BIND_DETAIL_FIELDS(type, ...) __VA_OPT__(LIBCZH_BIND_DETAIL_EXPAND(LIBCZH_BIND_DETAIL_HELPER(type, __VA_ARGS__)))
+#define LIBCZH_BIND_DETAIL_HELPER(type, field, ...) \
+::czh::bind::Field{#field, &type::field} __VA_OPT__(, LIBCZH_BIND_DETAIL_AGAIN LIBCZH_BIND_DETAIL_PARENS (type, __VA_ARGS__))
+#define LIBCZH_BIND_DETAIL_AGAIN() LIBCZH_BIND_DETAIL_HELPER
+
+// Describes the fields of `type` which are bound to czh, in the namespace of `type`.
+// Each field is bound to the Node with the same name.
+// std::optional fields may be missing, and the others are required.
+// At most 41 fields are supported, as many as LIBCZH_BIND_DETAIL_EXPAND rescans.
+#define LIBCZH_BIND(type, ...) \
+inline auto czh_bind_fields(const type *) \
+{ return std::make_tuple(LIBCZH_BIND_DETAIL_FIELDS(type, __VA_ARGS__)); }
+
+namespace czh::bind
+{
+  template<typename C, typename M>
+  struct Field
+  {
+    const char *name;
+    M C::*member;
+  };
+  
+  template<typename T>
+  concept Bindable = requires(const T *p) { czh_bind_fields(p); };
+  
+  namespace details
+  {
+    template<typename T>
+    struct is_optional : std::false_type {};
+    template<typename T>
+    struct is_optional<std::optional<T>> : std::true_type {};
+    template<typename T>
+    constexpr bool is_optional_v = is_optional<T>::value;
+    
+    template<typename T>
+    struct optional_value { using type = T; };
+    template<typename T>
+    struct optional_value<std::optional<T>> { using type = T; };
+    template<typename T>
+    using optional_value_t = typename optional_value<T>::type;
+    
+    template<typename T>
+    auto fields_of()
+    {
+      return czh_bind_fields(static_cast<const T *>(nullptr));
+    }
+    
+    // Calls f(field, index) for the field named `name`.
+    template<typename Tuple, typename F, std::size_t... I>
+    bool visit_field(const Tuple &fields, std::string_view name, F &&f, std::index_sequence<I...>)
+    {
+      return ((name == std::get<I>(fields).name ? (f(std::get<I>(fields), I), true) : false) || ...);
+    }
+    
+    template<typename Tuple, typename F, std::size_t... I>
+    void for_each_field(const Tuple &fields, F &&f, std::index_sequence<I...>)
+    {
+      (f(std::get<I>(fields), I), ...);
+    }
+  }
+  
+  // Fills `obj` from a Node tree.
+  template<Bindable T>
+  void from_node(const node::Node &node, T &obj, const std::source_location &l =
+  std::source_location::current())
+  {
+    auto fields = details::fields_of<T>();
+    details::for_each_field(fields, [&node, &obj, &l](auto &&field, std::size_t)
+    {
+      using M = std::remove_cvref_t<decltype(obj.*(field.member))>;
+      using V = details::optional_value_t<M>;
+      if (details::is_optional_v<M> && !node.has_node(field.name, l)) return;
+      auto &child = node(field.name, l);
+      if constexpr (Bindable<V>)
+      {
+        V tmp{};
+        from_node(child, tmp, l);
+        obj.*(field.member) = std::move(tmp);
+      }
+      else
+      {
+        obj.*(field.member) = child.template get<V>(l);
+      }
+    }, std::make_index_sequence<std::tuple_size_v<decltype(fields)>>{});
+  }
+  
+  template<Bindable T>
+  T from_node(const node::Node &node, const std::source_location &l =
+  std::source_location::current())
+  {
+    T ret{};
+    from_node(node, ret, l);
+    return ret;
+  }
+  
+  // Parses a czh straight into a Bindable struct, without building a Node tree.
+  // Unknown nodes are skipped. References can not be bound, because they may
+  // refer to nodes which are skipped.
+  class BindParser
+  {
+  private:
+    lexer::Lexer *lex;
+    token::Token curr_tok;
+  public:
+    explicit BindParser(lexer::Lexer *lex_)
+        : lex(lex_), curr_tok(token::TokenType::UNEXPECTED, 0, token::Pos(nullptr)) {}
+    
+    template<Bindable T>
+    T parse()
+    {
+      T ret{};
+      curr_tok = get();
+      error::czh_assert(curr_tok.type != token::TokenType::FEND, "Unexpected end of czh.");
+      parse_block(ret, true);
+      return ret;
+    }
+  
+  private:
+    template<Bindable T>
+    void parse_block(T &obj, bool is_root)
+    {
+      auto fields = details::fields_of<T>();
+      constexpr auto size = std::tuple_size_v<decltype(fields)>;
+      std::array<bool, size> seen{};
+      while (curr_tok.type != token::TokenType::FEND)
+      {
+        if (curr_tok.type == token::TokenType::SCEND)
+        {
+          if (is_root) curr_tok.report_error("Unexpected scope end.");
+          break;
+        }
+        if (curr_tok.type == token::TokenType::SEND)
+        {
+          curr_tok = get();
+          continue;
+        }
+        auto id_name = curr_tok.what.get<std::string>();
+        auto bak = token::Token(curr_tok);
+        curr_tok = get();//eat name
+        bool found = details::visit_field(fields, id_name, [this, &obj, &seen, &bak](auto &&field, std::size_t i)
+        {
+          if (seen[i]) bak.report_error("Duplicate node name.");
+          seen[i] = true;
+          parse_field(obj.*(field.member), bak);
+        }, std::make_index_sequence<size>{});
+        if (!found) skip();
+      }
+      details::for_each_field(fields, [this, &seen](auto &&field, std::size_t i)
+      {
+        using M = std::remove_cvref_t<decltype(std::declval<T>().*(field.member))>;
+        if (!seen[i] && !details::is_optional_v<M>)
+        {
+          curr_tok.report_error("There is no node named '" + std::string(field.name) + "'.");
+        }
+      }, std::make_index_sequence<size>{});
+      if (curr_tok.type == token::TokenType::SCEND)
+      {
+        curr_tok = get();//eat end
+      }
+    }
+    
+    template<typename M>
+    void parse_field(M &member, const token::Token &name)
+    {
+      using V = details::optional_value_t<M>;
+      // id:
+      if (curr_tok.type == token::TokenType::COLON)
+      {
+        curr_tok = get();//eat ':'
+        if constexpr (Bindable<V>)
+        {
+          V tmp{};
+          parse_block(tmp, false);
+          member = std::move(tmp);
+        }
+        else
+        {
+          name.report_error("This Node is not a value.");
+        }
+        return;
+      }
+      //id = xxx
+      curr_tok = get();//eat '='
+      if (curr_tok.type == token::TokenType::ID || curr_tok.type == token::TokenType::REF)
+      {
+        name.report_error("Can not bind a reference without building a Node.");
+      }
+      value::Value val;
+      if (curr_tok.type == token::TokenType::ARR_LP)
+      {
+        val = parse_array();
+      }
+      else
+      {
+        val = std::move(curr_tok.what);
+        curr_tok = get();//eat value
+      }
+      if constexpr (Bindable<V>)
+      {
+        name.report_error("This Node is not a node.");
+      }
+      else
+      {
+        if (!val.can_get<V>())
+        {
+          name.report_error("The value is not '" + std::string(value::details::nameof<V>()) + "'.[Actual T = '"
+                            + val.get_typename() + "'].");
+        }
+        member = val.get<V>();
+      }
+    }
+    
+    value::Value parse_array()
+    {
+      value::ArrayBuilder ret;
+      curr_tok = get();//eat [
+      for (; curr_tok.type != token::TokenType::ARR_RP; curr_tok = get())
+      {
+        if (curr_tok.type == token::TokenType::COMMA) continue;
+        std::visit(utils::overloaded{
+            [&ret](auto &&a) { ret.add(a); },
+            [](const value::Reference &) { error::czh_unreachable(); },
+            [](const value::Array &) { error::czh_unreachable(); },
+            [](const value::details::PackedArray &) { error::czh_unreachable(); }
+        }, value::details::stored(curr_tok.what));
+      }
+      curr_tok = get();//eat ]
+      return ret.get();
+    }
+    
+    // Skips the rest of an unknown node, whose name has been eaten.
+    void skip()
+    {
+      if (curr_tok.type == token::TokenType::COLON)
+      {
+        for (int depth = 1; depth > 0 && curr_tok.type != token::TokenType::FEND;)
+        {
+          curr_tok = get();
+          if (curr_tok.type == token::TokenType::COLON) ++depth;
+          else if (curr_tok.type == token::TokenType::SCEND) --depth;
+        }
+        curr_tok = get();//eat end
+        return;
+      }
+      curr_tok = get();//eat '='
+      if (curr_tok.type == token::TokenType::ARR_LP)
+      {
+        while (curr_tok.type != token::TokenType::ARR_RP) curr_tok = get();
+        curr_tok = get();//eat ]
+      }
+      else if (curr_tok.type == token::TokenType::ID || curr_tok.type == token::TokenType::REF)
+      {
+        bool id = false;
+        while (curr_tok.type == token::TokenType::ID || curr_tok.type == token::TokenType::REF)
+        {
+          if (curr_tok.type == token::TokenType::ID)
+          {
+            if (id) break;// double id
+            id = true;
+          }
+          else
+          {
+            id = false;
+          }
+          curr_tok = get();
+        }
+      }
+      else
+      {
+        curr_tok = get();//eat value
+      }
+    }
+    
+    token::Token get()
+    {
+      return lex->get();
+    }
+  };
+}
+#endif
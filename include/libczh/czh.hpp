@@ -15,12 +15,21 @@
 #define LIBCZH_CZH_HPP
 #pragma once
 
+#include "bind.hpp"
+#include "document.hpp"
 #include "dtoa.hpp"
 #include "error.hpp"
 #include "file.hpp"
 #include "lexer.hpp"
 #include "node.hpp"
+#include "overlay.hpp"
 #include "parser.hpp"
+#include "patch.hpp"
+#include "path.hpp"
+#include "schema.hpp"
+#include "shared.hpp"
+#include "snapshot.hpp"
+#include "tape.hpp"
 #include "token.hpp"
 #include "utils.hpp"
 #include "value.hpp"
@@ -28,11 +37,22 @@
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <optional>
+#include <string_view>
+#include <thread>
 
 namespace czh
 {
   using czh::parser::Parser;
   using czh::node::Node;
+  using czh::path::Path;
+  using czh::document::Document;
+  using czh::snapshot::Snapshot;
+  using czh::overlay::Overlay;
+  using czh::shared::SharedConfig;
+  using czh::patch::Patch;
+  using czh::patch::diff;
+  using czh::patch::apply;
   using czh::lexer::Lexer;
   using czh::error::Error;
   using czh::error::CzhError;
@@ -49,9 +69,10 @@ namespace czh
   private:
     Lexer lexer;
     Parser parser;
+    const schema::Schema *schema;
   public:
     explicit Czh(const std::string &path, InputMode mode)
-        : parser(&lexer)
+        : parser(&lexer), schema(nullptr)
     {
       if (mode == InputMode::file)
       {
@@ -67,10 +88,120 @@ namespace czh
       }
     }
   
+    // Checks the czh against `s` while parsing. `s` must outlive this Czh.
+    Czh &set_schema(const schema::Schema &s)
+    {
+      schema = &s;
+      parser.set_schema(schema);
+      return *this;
+    }
+  
     Node parse()
     {
       return std::move(parser.parse());
     }
+  
+    // Parses into a Document, whose Nodes are allocated in its arena.
+    Document parse_document()
+    {
+      Document doc;
+      Parser doc_parser(&lexer, doc.resource());
+      doc_parser.set_schema(schema);
+      doc_parser.parse_into(*doc);
+      return doc;
+    }
+  
+    // Parses a Patch written by Patch::accept().
+    patch::Patch parse_patch()
+    {
+      return patch::Patch(parser.parse(false));
+    }
+  
+    // Parses into a read-only Tape instead of a Node tree.
+    tape::Tape parse_tape()
+    {
+      tape::TapeParser tape_parser(&lexer);
+      return tape_parser.parse();
+    }
+  
+    // Applies `edit` to the code, and reparses only the innermost block which contains it.
+    // `node` must be the result of parse() on this Czh. Returns the reparsed Node.
+    Node &reparse(Node &node, const parser::Edit &edit)
+    {
+      auto file = std::dynamic_pointer_cast<file::NonStreamFile>(lexer.get_file());
+      error::czh_assert(file != nullptr, "Stream input can not be reparsed.");
+      return parser::reparse(node, file, edit);
+    }
+  
+    // Parses straight into a struct described by LIBCZH_BIND, without building a Node tree.
+    template<bind::Bindable T>
+    T parse()
+    {
+      bind::BindParser bind_parser(&lexer);
+      return bind_parser.parse<T>();
+    }
+  
+    // Stream input can not be split, so it is parsed on the current thread.
+    Node parse_parallel(std::size_t threads = std::thread::hardware_concurrency())
+    {
+      auto file = std::dynamic_pointer_cast<file::NonStreamFile>(lexer.get_file());
+      if (file == nullptr || threads <= 1)
+      {
+        return parse();
+      }
+      return parser::parse_parallel(file->get_name(), file->code, threads, schema);
+    }
+  };
+  
+  // Parses czhs one after another, and keeps the buffers of the last one, including the
+  // code, the structural index and the Nodes. After warm-up, parsing a czh of a similar
+  // shape makes almost no allocations.
+  class ParseContext
+  {
+  private:
+    Lexer lexer;
+    node::NodePool pool;
+    std::optional<Node> root;
+    std::shared_ptr<std::string> text;
+    std::shared_ptr<file::NonStreamFile> file;
+    std::string filename;
+  public:
+    explicit ParseContext(std::string filename_ = "czh from ParseContext")
+        : filename(std::move(filename_)) {}
+    
+    // The returned Node is valid until the next parse() or reset().
+    Node &parse(std::string_view code)
+    {
+      reset();
+      // A copy of the last Node may still refer to the file.
+      if (file == nullptr || file.use_count() != 1 || text.use_count() != 2)
+      {
+        text = std::make_shared<std::string>(code);
+        file = std::make_shared<file::NonStreamFile>(filename, text, 0, text->size());
+      }
+      else
+      {
+        text->assign(code);
+        file->codepos = 0;
+        file->codeend = text->size();
+      }
+      lexer.set_czh(file);
+      Parser parser(&lexer);
+      parser.set_pool(&pool);
+      root.emplace(parser.parse());
+      return *root;
+    }
+    
+    // Moves the last Node into the pool.
+    void reset()
+    {
+      if (root)
+      {
+        pool.recycle(*root);
+        root.reset();
+      }
+      lexer.close();
+    }
   };
   
   inline namespace literals
@@ -0,0 +1,91 @@
+//   Copyright 2021-2023 libczh - caozhanhao
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+#ifndef LIBCZH_DOCUMENT_HPP
+#define LIBCZH_DOCUMENT_HPP
+#pragma once
+
+#include "node.hpp"
+
+#include <memory>
+#include <memory_resource>
+
+namespace czh::document
+{
+  // Owns a Node tree whose Nodes and child lists are allocated in a monotonic arena,
+  // so they are allocated quickly and released together. Names and values are still
+  // allocated as usual if they do not fit in a std::string's small buffer.
+  // Nodes must not be moved out of the Document, but they can be copied.
+  // The root is held by pointer, so moving a Document is O(1).
+  class Document
+  {
+  private:
+    std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
+    std::unique_ptr<node::Node> root;
+  public:
+    explicit Document(std::size_t initial_size = 0)
+        : arena(initial_size == 0 ? std::make_unique<std::pmr::monotonic_buffer_resource>()
+                                  : std::make_unique<std::pmr::monotonic_buffer_resource>(initial_size)),
+          root(std::make_unique<node::Node>(arena.get())) {}
+    
+    Document(Document &&) noexcept = default;
+    
+    // The old root is released before its arena.
+    Document &operator=(Document &&d) noexcept
+    {
+      root = std::move(d.root);
+      arena = std::move(d.arena);
+      return *this;
+    }
+    
+    Document(const Document &) = delete;
+    
+    Document &operator=(const Document &) = delete;
+    
+    [[nodiscard]] node::Node &get()
+    {
+      return *root;
+    }
+    
+    [[nodiscard]] const node::Node &get() const
+    {
+      return *root;
+    }
+    
+    node::Node &operator*()
+    {
+      return *root;
+    }
+    
+    const node::Node &operator*() const
+    {
+      return *root;
+    }
+    
+    node::Node *operator->()
+    {
+      return root.get();
+    }
+    
+    const node::Node *operator->() const
+    {
+      return root.get();
+    }
+    
+    [[nodiscard]] std::pmr::memory_resource *resource() const
+    {
+      return arena.get();
+    }
+  };
+}
+#endif
@@ -17,6 +17,7 @@
 
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <source_location>
 
 namespace czh::error
@@ -81,14 +82,15 @@ namespace czh::error
     throw Error(detail_, l);
   }
   
+  // The message is only copied on failure, so checking in a hot path does not allocate.
   void czh_assert(bool b,
-                  const std::string &detail_ = "Assertion failed.",
+                  std::string_view detail_ = "Assertion failed.",
                   const std::source_location &l =
                   std::source_location::current())
   {
     if (!b)
     {
-      throw Error(detail_, l);
+      throw Error(std::string(detail_), l);
     }
   }
 }
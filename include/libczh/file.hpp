@@ -20,6 +20,7 @@
 #include <string>
 #include <fstream>
 #include <limits>
+#include <vector>
 
 namespace czh::file
 {
@@ -47,6 +48,15 @@ namespace czh::file
     [[nodiscard]] virtual char peek() = 0;
     
     [[nodiscard]] virtual bool check() = 0;
+  
+    // The number of edits made to the file. A position taken at an older version is
+    // moved to the current code by current_pos().
+    [[nodiscard]] virtual std::size_t version() const { return 0; }
+  
+    [[nodiscard]] virtual std::size_t current_pos(std::size_t pos, std::size_t, std::size_t) const
+    {
+      return pos;
+    }
   };
   
   class StreamFile : public File
@@ -145,11 +155,22 @@ namespace czh::file
   class NonStreamFile : public File
   {
   public:
-    std::string code;
+    std::shared_ptr<const std::string> code;
     std::size_t codepos;
+    std::size_t codeend;
+    // The end of each edit in the code before it, and the change of the size.
+    std::vector<std::pair<std::size_t, std::ptrdiff_t>> edits;
   public:
     NonStreamFile(std::string name, std::string code_)
-        : File(std::move(name)), code(std::move(code_)), codepos(0) {}
+        : File(std::move(name)), code(std::make_shared<const std::string>(std::move(code_))), codepos(0)
+    {
+      codeend = code->size();
+    }
+  
+    // Reads only [beg, end) of a buffer shared with other files, while positions
+    // and line numbers still refer to the whole buffer.
+    NonStreamFile(std::string name, std::shared_ptr<const std::string> code_, std::size_t beg, std::size_t end)
+        : File(std::move(name)), code(std::move(code_)), codepos(beg), codeend(end) {}
     
     [[nodiscard]] std::string get_spec_line(std::size_t beg, std::size_t end, std::size_t linenosize) const override
     {
@@ -157,9 +178,9 @@ namespace czh::file
       bool first_line_flag = true;
       bool first_line_no = true;
       std::string ret;
-      for (std::size_t i = 0; i < code.size() && lineno < end; ++i)
+      for (std::size_t i = 0; i < code->size() && lineno < end; ++i)
       {
-        if (code[i] == '\n')
+        if ((*code)[i] == '\n')
         {
           ++lineno;
           first_line_flag = true;
@@ -179,8 +200,8 @@ namespace czh::file
             ret += addition + "| ";
             first_line_flag = false;
           }
-          if (code[i] != '\r')
-            ret += code[i];
+          if ((*code)[i] != '\r')
+            ret += (*code)[i];
         }
       }
       while (ret.back() == '\r' || ret.back() == '\n')
@@ -195,7 +216,7 @@ namespace czh::file
       std::size_t lineno = 1;
       for (std::size_t i = 0; i < pos; ++i)
       {
-        if (code[i] == '\n')
+        if ((*code)[i] == '\n')
           lineno++;
       }
       return lineno;
@@ -206,7 +227,7 @@ namespace czh::file
       int i = static_cast<int>(pos);
       if (pos != 1)
         --i;
-      while (code[i] != '\n' && i >= 0)
+      while (i >= 0 && (*code)[i] != '\n')
         --i;
       return pos - i;
     }
@@ -218,22 +239,37 @@ namespace czh::file
     
     [[nodiscard]] std::size_t size() const override
     {
-      return code.size();
+      return code->size();
     }
   
     [[nodiscard]] char get() override
     {
-      return code[codepos++];
+      auto p = codepos++;
+      return p < codeend ? (*code)[p] : '\0';
     }
   
     [[nodiscard]] char peek() override
     {
-      return code[codepos + 1];
+      return codepos + 1 < codeend ? (*code)[codepos + 1] : '\0';
     }
   
     [[nodiscard]] bool check() override
     {
-      return codepos < code.size();
+      return codepos < codeend;
+    }
+  
+    [[nodiscard]] std::size_t version() const override
+    {
+      return edits.size();
+    }
+  
+    [[nodiscard]] std::size_t current_pos(std::size_t pos, std::size_t size, std::size_t ver) const override
+    {
+      for (auto i = ver; i < edits.size(); ++i)
+      {
+        if (pos - 1 - size >= edits[i].first) pos += edits[i].second;
+      }
+      return pos;
     }
   };
 }
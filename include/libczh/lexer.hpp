@@ -28,6 +28,8 @@
 #include <string>
 #include <map>
 #include <algorithm>
+#include <bit>
+#include <cstdint>
 
 namespace czh::lexer
 {
@@ -246,6 +248,141 @@ namespace czh::lexer
     return ss.str();
   }
   
+  namespace details
+  {
+    // Skips blanks and notes.
+    std::size_t skip_blank(const std::string &code, std::size_t i, std::size_t end)
+    {
+      while (i < end)
+      {
+        if (std::isspace(static_cast<unsigned char>(code[i]))) ++i;
+        else if (code[i] == '<')
+        {
+          int notes = 0;
+          ++i;
+          while (i < end && !(code[i] == '>' && notes == 0))
+          {
+            if (code[i] == '<') ++notes;
+            if (code[i] == '>') --notes;
+            ++i;
+          }
+          ++i;
+        }
+        else break;
+      }
+      return i;
+    }
+    
+    // A structural scan which only knows about strings, notes and blocks.
+    // f(i, depth) is called after every 'end' of a block, where i is right after
+    // the 'end' and may be moved forward. The scan stops when f returns false.
+    template<typename F>
+    void scan_blocks(const std::string &code, std::size_t beg, std::size_t end, std::size_t depth, F &&f)
+    {
+      auto is_id = [](char c)
+      {
+        return static_cast<unsigned char>(c) >= 0x80 || std::isalnum(static_cast<unsigned char>(c)) || c == '_';
+      };
+      bool last_id = false;
+      std::size_t i = skip_blank(code, beg, end);
+      while (i < end)
+      {
+        char c = code[i];
+        if (c == '"')
+        {
+          ++i;
+          while (i < end && code[i] != '"')
+          {
+            if (code[i] == '\\') ++i;
+            ++i;
+          }
+          ++i;
+          last_id = false;
+        }
+        else if (c == ':')
+        {
+          if (i + 1 < end && code[i + 1] == ':') ++i;
+          else if (last_id) ++depth;
+          ++i;
+          last_id = false;
+        }
+        else if (std::isdigit(static_cast<unsigned char>(c)) || c == '.' || c == '+' || c == '-')
+        {
+          ++i;
+          while (i < end && (std::isdigit(static_cast<unsigned char>(code[i])) || code[i] == '.'
+                             || code[i] == 'e' || code[i] == 'E' || code[i] == '+' || code[i] == '-'))
+          {
+            ++i;
+          }
+          last_id = false;
+        }
+        else if (is_id(c))
+        {
+          auto id_beg = i;
+          while (i < end && is_id(code[i])) ++i;
+          last_id = true;
+          if (code.compare(id_beg, i - id_beg, "end") == 0 && depth > 0)
+          {
+            last_id = false;
+            if (!f(i, --depth)) return;
+          }
+        }
+        else
+        {
+          ++i;
+          last_id = false;
+        }
+        i = skip_blank(code, i, end);
+      }
+    }
+  }
+  
+  // A structural pre-scan which only knows about strings, notes and blocks.
+  // It splits [beg, end) into about `chunks` ranges, cut right after a top-level
+  // 'end' (and its ';'), so that each range is a czh on its own.
+  std::vector<std::pair<std::size_t, std::size_t>>
+  split_top_level(const std::string &code, std::size_t beg, std::size_t end, std::size_t chunks)
+  {
+    std::vector<std::pair<std::size_t, std::size_t>> ret;
+    std::size_t target = (end - beg) / (std::max)(chunks, std::size_t(1));
+    std::size_t chunk_beg = beg;
+    details::scan_blocks(code, beg, end, 0, [&](std::size_t &i, std::size_t depth)
+    {
+      if (depth != 0) return true;
+      i = details::skip_blank(code, i, end);
+      if (i < end && code[i] == ';') ++i;
+      if (i - chunk_beg >= target)
+      {
+        ret.emplace_back(chunk_beg, i);
+        chunk_beg = i;
+      }
+      return true;
+    });
+    if (ret.empty() || details::skip_blank(code, chunk_beg, end) < end)
+    {
+      ret.emplace_back(chunk_beg, end);
+    }
+    else
+    {
+      ret.back().second = end;
+    }
+    return ret;
+  }
+  
+  // Returns the position of the 'end' which closes the block whose body begins at `beg`,
+  // or std::string::npos if it is not in [beg, end).
+  std::size_t find_block_end(const std::string &code, std::size_t beg, std::size_t end)
+  {
+    std::size_t ret = std::string::npos;
+    details::scan_blocks(code, beg, end, 1, [&ret](std::size_t &i, std::size_t depth)
+    {
+      if (depth != 0) return true;
+      ret = i - 3;
+      return false;
+    });
+    return ret;
+  }
+  
   class NumberMatch
   {
   private:
@@ -449,6 +586,217 @@ namespace czh::lexer
     }
   };
   
+  // Stage 1 of the Lexer. It finds whitespace, notes, quotes, backslashes and the
+  // structural characters 64 bytes at a time, so that the Lexer can jump over blanks,
+  // strings, names and numbers without reading them one character at a time.
+  class StructuralIndex
+  {
+  public:
+    static constexpr std::size_t npos = (std::numeric_limits<std::size_t>::max)();
+  private:
+    std::vector<std::uint64_t> blank;// whitespace and notes
+    std::vector<std::uint64_t> quote;// unescaped '"'
+    std::vector<std::uint64_t> backslash;
+    std::vector<std::uint64_t> notes;// '<' and '>'
+    std::vector<std::uint64_t> structural;// '=', ':', ';', ',', '{' and '}'
+    std::size_t length;
+    std::size_t unclosed_note;// the '<' of a note which is not closed
+  public:
+    StructuralIndex() : length(0), unclosed_note(npos) {}
+    
+    void build(const char *data, std::size_t size)
+    {
+      length = size;
+      unclosed_note = npos;
+      std::size_t blocks = (size + 63) / 64;
+      blank.assign(blocks, 0);
+      quote.assign(blocks, 0);
+      backslash.assign(blocks, 0);
+      notes.assign(blocks, 0);
+      structural.assign(blocks, 0);
+      std::uint64_t prev_escaped = 0;
+      char tail[64];
+      for (std::size_t b = 0; b < blocks; ++b)
+      {
+        const char *block = data + b * 64;
+        if (size - b * 64 < 64)
+        {
+          std::fill(std::begin(tail), std::end(tail), 0);
+          std::copy(block, data + size, tail);
+          block = tail;
+        }
+        std::uint64_t space = 0, q = 0, bs = 0, lt = 0, gt = 0, st = 0;
+        for (int i = 0; i < 8; ++i)
+        {
+          auto w = load(block + i * 8);
+          auto shift = i * 8;
+          space |= (eq(w, ' ') | eq(w, '\t') | eq(w, '\n') | eq(w, '\r') | eq(w, '\v') | eq(w, '\f')) << shift;
+          q |= eq(w, '"') << shift;
+          bs |= eq(w, '\\') << shift;
+          lt |= eq(w, '<') << shift;
+          gt |= eq(w, '>') << shift;
+          st |= (eq(w, '=') | eq(w, ':') | eq(w, ';') | eq(w, ',') | eq(w, '{') | eq(w, '}')) << shift;
+        }
+        blank[b] = space;
+        quote[b] = q & ~find_escaped(bs, prev_escaped);
+        backslash[b] = bs;
+        notes[b] = lt | gt;
+        structural[b] = st;
+      }
+      
+      // Strings and notes can contain each other's delimiters, so they are resolved
+      // in order. Only the flagged positions are visited here.
+      enum class State { normal, string, note } state = State::normal;
+      int depth = 0;
+      std::size_t note_beg = 0;
+      for (std::size_t b = 0; b < blocks; ++b)
+      {
+        for (auto bits = quote[b] | notes[b]; bits != 0; bits &= bits - 1)
+        {
+          std::size_t pos = b * 64 + std::countr_zero(bits);
+          char c = data[pos];
+          if (state == State::normal)
+          {
+            if (c == '"') state = State::string;
+            else if (c == '<')
+            {
+              state = State::note;
+              depth = 0;
+              note_beg = pos;
+            }
+          }
+          else if (state == State::string)
+          {
+            if (c == '"') state = State::normal;
+          }
+          else if (c == '<') ++depth;
+          else if (c == '>')
+          {
+            if (depth-- == 0)
+            {
+              set_range(blank, note_beg, pos + 1);
+              state = State::normal;
+            }
+          }
+        }
+      }
+      if (state == State::note)
+      {
+        set_range(blank, note_beg, size);
+        unclosed_note = note_beg;
+      }
+    }
+    
+    [[nodiscard]]bool empty() const { return blank.empty(); }
+    
+    [[nodiscard]]std::size_t size() const { return length; }
+    
+    // The '<' of a note which runs to the end, or npos.
+    [[nodiscard]]std::size_t unclosed_note_pos() const { return unclosed_note; }
+    
+    // The first position not less than `pos` which is neither whitespace nor in a note.
+    [[nodiscard]]std::size_t next_significant(std::size_t pos) const
+    {
+      auto ret = next_bit(blank, pos, ~std::uint64_t(0));
+      return ret == npos ? length : (std::min)(ret, length);
+    }
+    
+    [[nodiscard]]std::size_t next_quote(std::size_t pos) const
+    {
+      return next_bit(quote, pos, 0);
+    }
+    
+    // The first position not less than `pos` which ends a name or a number, that is whitespace,
+    // a note, a quote or a structural character, or size() if there is none.
+    [[nodiscard]]std::size_t next_delimiter(std::size_t pos) const
+    {
+      std::size_t b = pos / 64;
+      if (b >= blank.size()) return length;
+      auto word = delimiters(b) & (~std::uint64_t(0) << (pos % 64));
+      while (word == 0)
+      {
+        if (++b >= blank.size()) return length;
+        word = delimiters(b);
+      }
+      return (std::min)(b * 64 + std::countr_zero(word), length);
+    }
+    
+    // The first backslash in [pos, end), or `end` if there is none.
+    [[nodiscard]]std::size_t next_backslash(std::size_t pos, std::size_t end) const
+    {
+      return (std::min)(next_bit(backslash, pos, 0, end), end);
+    }
+  
+  private:
+    [[nodiscard]]std::uint64_t delimiters(std::size_t b) const
+    {
+      return blank[b] | quote[b] | notes[b] | structural[b];
+    }
+    
+    static std::uint64_t load(const char *p)
+    {
+      std::uint64_t w = 0;
+      for (int i = 7; i >= 0; --i)
+      {
+        w = (w << 8) | static_cast<unsigned char>(p[i]);
+      }
+      return w;
+    }
+    
+    // One bit for each byte of `w` which equals `c`.
+    static std::uint64_t eq(std::uint64_t w, char c)
+    {
+      constexpr std::uint64_t low7 = 0x7F7F7F7F7F7F7F7FULL;
+      auto t = w ^ (0x0101010101010101ULL * static_cast<unsigned char>(c));
+      auto zero = ~(((t & low7) + low7) | t | low7);
+      return ((zero >> 7) * 0x0102040810204080ULL) >> 56;
+    }
+    
+    // Characters preceded by an odd number of backslashes. (from simdjson)
+    static std::uint64_t find_escaped(std::uint64_t bs, std::uint64_t &prev_escaped)
+    {
+      constexpr std::uint64_t even_bits = 0x5555555555555555ULL;
+      bs &= ~prev_escaped;
+      std::uint64_t follows_escape = bs << 1 | prev_escaped;
+      std::uint64_t odd_starts = bs & ~even_bits & ~follows_escape;
+      std::uint64_t even_sequences = odd_starts + bs;
+      prev_escaped = even_sequences < odd_starts;
+      std::uint64_t invert_mask = even_sequences << 1;
+      return (even_bits ^ invert_mask) & follows_escape;
+    }
+    
+    static void set_range(std::vector<std::uint64_t> &bits, std::size_t beg, std::size_t end)
+    {
+      for (; beg < end && beg % 64 != 0; ++beg)
+      {
+        bits[beg / 64] |= std::uint64_t(1) << (beg % 64);
+      }
+      for (; beg + 64 <= end; beg += 64)
+      {
+        bits[beg / 64] = ~std::uint64_t(0);
+      }
+      for (; beg < end; ++beg)
+      {
+        bits[beg / 64] |= std::uint64_t(1) << (beg % 64);
+      }
+    }
+    
+    static std::size_t next_bit(const std::vector<std::uint64_t> &bits, std::size_t pos, std::uint64_t flip,
+                                std::size_t end = npos)
+    {
+      std::size_t b = pos / 64;
+      std::size_t last = (std::min)(bits.size(), end / 64 + 1);
+      if (b >= last) return npos;
+      auto word = (bits[b] ^ flip) & (~std::uint64_t(0) << (pos % 64));
+      while (word == 0)
+      {
+        if (++b >= last) return npos;
+        word = bits[b] ^ flip;
+      }
+      return b * 64 + std::countr_zero(word);
+    }
+  };
+  
   class Lexer
   {
   private:
@@ -459,13 +807,26 @@ namespace czh::lexer
     token::Token buffer;
     bool is_eof;
     char ch;
+    StructuralIndex index;
+    std::size_t index_beg;
+    bool indexed;
   public:
     Lexer()
         : code(nullptr),
           codepos(nullptr),
           is_eof(false),
           ch(0),
-          buffer(token::TokenType::UNEXPECTED, 0, codepos) {}
+          buffer(token::TokenType::UNEXPECTED, 0, codepos),
+          index_beg(0),
+          indexed(true) {}
+  
+    // Reads one character at a time without the structural index, as for a stream.
+    // Only for comparing the two in benchmarks. Takes effect from the next set_czh().
+    Lexer &set_indexed(bool b)
+    {
+      indexed = b;
+      return *this;
+    }
   
     void reset()
     {
@@ -481,6 +842,7 @@ namespace czh::lexer
       error::czh_assert(fs->good(), error::czh_invalid_file);
       code = std::make_shared<file::StreamFile>(std::move(filename), std::move(fs));
       codepos = token::Pos(code);
+      index = StructuralIndex();
       ch = get_char();
     }
   
@@ -488,6 +850,7 @@ namespace czh::lexer
     {
       code = std::make_shared<file::NonStreamFile>(filename, get_string_from_file(path));
       codepos = token::Pos(code);
+      build_index();
       ch = get_char();
     }
     
@@ -495,9 +858,42 @@ namespace czh::lexer
     {
       code = std::make_shared<file::NonStreamFile>("czh from std::string", std::move(str));
       codepos = token::Pos(code);
+      build_index();
+      ch = get_char();
+    }
+  
+    // Reads a file owned by the caller, which may be reused after close().
+    void set_czh(std::shared_ptr<file::NonStreamFile> file)
+    {
+      code = std::move(file);
+      codepos = token::Pos(code);
+      codepos.pos = static_cast<file::NonStreamFile *>(code.get())->codepos;
+      build_index();
       ch = get_char();
     }
   
+    // Releases the file, and keeps the buffers for the next set_czh().
+    void close()
+    {
+      code = nullptr;
+      codepos = token::Pos(nullptr);
+      reset();
+    }
+  
+    void set_czh(std::string filename, std::shared_ptr<const std::string> str, std::size_t beg, std::size_t end)
+    {
+      code = std::make_shared<file::NonStreamFile>(std::move(filename), std::move(str), beg, end);
+      codepos = token::Pos(code);
+      codepos.pos = beg;
+      build_index();
+      ch = get_char();
+    }
+  
+    [[nodiscard]]std::shared_ptr<file::File> get_file() const
+    {
+      return code;
+    }
+  
     token::Token get()
     {
       token::Token t = std::move(buffer);
@@ -548,12 +944,80 @@ namespace czh::lexer
       return codepos;
     }
   
+    void build_index()
+    {
+      auto file = static_cast<file::NonStreamFile *>(code.get());
+      index_beg = file->codepos;
+      if (!indexed)
+      {
+        index = StructuralIndex();
+        return;
+      }
+      index.build(file->code->data() + index_beg, file->codeend - index_beg);
+    }
+    
+    // Only for NonStreamFile. Moves to `pos` in the indexed range, so that `ch` is the character at `pos`.
+    void seek(std::size_t pos)
+    {
+      auto file = static_cast<file::NonStreamFile *>(code.get());
+      file->codepos = index_beg + pos;
+      codepos.pos = index_beg + pos;
+      ch = get_char();
+    }
+    
+    [[nodiscard]]std::size_t index_pos() const
+    {
+      return codepos.pos - 1 - index_beg;
+    }
+    
+    [[nodiscard]]const char *index_data() const
+    {
+      return static_cast<file::NonStreamFile *>(code.get())->code->data() + index_beg;
+    }
+  
+    static void unescape(std::string &str, char c)
+    {
+      switch (c)
+      {
+        case '"':
+          str += '\"';
+          break;
+        case '\\':
+          str += '\\';
+          break;
+        case 'b':
+          str += '\b';
+          break;
+        case 'f':
+          str += '\f';
+          break;
+        case 'n':
+          str += '\n';
+          break;
+        case 'r':
+          str += '\r';
+          break;
+        case 't':
+          str += '\t';
+          break;
+        default:
+          str += '\\';
+          str += c;
+          break;
+      }
+    }
+  
     [[nodiscard]]std::size_t get_character_size() const
     {
-      if ((ch & 0x80) == 0x00) return 1;
-      if ((ch & 0xE0) == 0xC0) return 2;
-      if ((ch & 0xF0) == 0xE0) return 3;
-      if ((ch & 0xF8) == 0xF0) return 4;
+      return character_size(ch);
+    }
+    
+    static std::size_t character_size(char c)
+    {
+      if ((c & 0x80) == 0x00) return 1;
+      if ((c & 0xE0) == 0xC0) return 2;
+      if ((c & 0xF0) == 0xE0) return 3;
+      if ((c & 0xF8) == 0xF0) return 4;
       return 0;
     }
   
@@ -574,7 +1038,7 @@ namespace czh::lexer
           if (ch == '>') --notes;
           ch = get_char();
         }
-        if (notes != 0 && !check_char())
+        if (!check_char() && !(ch == '>' && notes == 0))
         {
           token::Token tmp(token::TokenType::UNEXPECTED, static_cast<int>('<'), bak);
           tmp.report_error("Expected '>' to match this '<'.");
@@ -586,6 +1050,44 @@ namespace czh::lexer
       }
     }
   
+    // The size of the character at `p` in a number, or 0 if it does not belong to one.
+    static std::size_t number_char(const char *p)
+    {
+      return std::isdigit(static_cast<unsigned char>(*p)) || *p == '.' || *p == 'e' || *p == 'E'
+             || *p == '+' || *p == '-';
+    }
+    
+    // The size of the character at `p` in a name, or 0 if it does not belong to one.
+    static std::size_t id_char(const char *p)
+    {
+      auto size = character_size(*p);
+      if (size > 1) return size;
+      return std::isalnum(static_cast<unsigned char>(*p)) || *p == '_';
+    }
+    
+    // Reads the name or number at `ch` in one go, up to the next delimiter in the index.
+    // Returns false, and reads nothing, if there is no index, if it runs to the end of file,
+    // or if a character before the delimiter does not belong to it, which the slow path handles.
+    bool indexed_word(std::string &word, std::size_t (*char_size)(const char *))
+    {
+      if (index.empty()) return false;
+      auto beg = index_pos();
+      auto end = index.next_delimiter(beg + 1);
+      if (end >= index.size()) return false;
+      auto data = index_data();
+      auto p = beg;
+      while (p < end)
+      {
+        auto size = char_size(data + p);
+        if (size == 0) return false;
+        p += size;
+      }
+      if (p != end) return false;
+      word.assign(data + beg, end - beg);
+      seek(end);
+      return true;
+    }
+    
     token::Token get_tok()
     {
       static std::map<int, token::TokenType> marks =
@@ -598,6 +1100,21 @@ namespace czh::lexer
               {',', token::TokenType::COMMA}
           };
       //space and note
+      if (!index.empty() && check_char() && ((get_character_size() == 1 && isspace(ch)) || ch == '<'))
+      {
+        auto next = index.next_significant(index_pos());
+        // The blanks before the end of file are left to skip().
+        if (next < index.size())
+        {
+          seek(next);
+        }
+        else if (auto note = index.unclosed_note_pos(); note != StructuralIndex::npos)
+        {
+          seek(note);
+          token::Token(token::TokenType::UNEXPECTED, static_cast<int>('<'), get_pos().set_size(1))
+              .report_error("Expected '>' to match this '<'.");
+        }
+      }
       while (check_char() && ((get_character_size() == 1 && isspace(ch)) || ch == '<'))
       {
         skip();
@@ -606,12 +1123,16 @@ namespace czh::lexer
       if (get_character_size() == 1 && (std::isdigit(ch) || ch == '.'
                                         || ch == '+' || ch == '-'))
       {
-        std::string temp(1, ch);
-        while (std::isdigit(ch = get_char())
-               || ch == '.' || ch == 'e' || ch == 'E'
-               || ch == '+' || ch == '-')
+        std::string temp;
+        if (!indexed_word(temp, number_char))
         {
-          temp += ch;
+          temp = ch;
+          while (std::isdigit(ch = get_char())
+                 || ch == '.' || ch == 'e' || ch == 'E'
+                 || ch == '+' || ch == '-')
+          {
+            temp += ch;
+          }
         }
         if (nmatch.match(temp))
         {
@@ -654,40 +1175,32 @@ namespace czh::lexer
       else if (ch == '"')
       {
         std::string temp;
+        if (!index.empty())
+        {
+          auto open = index_pos();
+          auto close = index.next_quote(open + 1);
+          if (close != StructuralIndex::npos)
+          {
+            auto data = index_data();
+            for (auto p = open + 1; p < close;)
+            {
+              auto bs = index.next_backslash(p, close);
+              temp.append(data + p, bs - p);
+              if (bs == close) break;
+              unescape(temp, data[bs + 1]);
+              p = bs + 2;
+            }
+            seek(close + 1);
+            return {token::TokenType::VALUE, temp, get_pos().set_size(temp.size())};
+          }
+        }
         ch = get_char();
         bool escape = false;
         while (check_char() && !(!escape && ch == '"'))
         {
           if (escape)
           {
-            switch (ch)
-            {
-              case '"':
-                temp += '\"';
-                break;
-              case '\\':
-                temp += '\\';
-                break;
-              case 'b':
-                temp += '\b';
-                break;
-              case 'f':
-                temp += '\f';
-                break;
-              case 'n':
-                temp += '\n';
-                break;
-              case 'r':
-                temp += '\r';
-                break;
-              case 't':
-                temp += '\t';
-                break;
-              default:
-                temp += '\\';
-                temp += ch;
-                break;
-            }
+            unescape(temp, ch);
             ch = get_char();
             escape = false;
           }
@@ -710,21 +1223,24 @@ namespace czh::lexer
       else if (get_character_size() > 1 || isalpha(ch) || ch == '_')
       {
         std::string temp;
-        auto get_multichar = [&temp, this]
+        if (!indexed_word(temp, id_char))
         {
-          auto nchar = get_character_size();
-          for (int i = 0; check_char() && i < nchar; ++i)
+          auto get_multichar = [&temp, this]
           {
-            temp += ch;
-            ch = get_char();
+            auto nchar = get_character_size();
+            for (int i = 0; check_char() && i < nchar; ++i)
+            {
+              temp += ch;
+              ch = get_char();
+            }
+          };
+          do { get_multichar(); }
+          while (check_char() && (get_character_size() > 1 || isalnum(ch) || ch == '_'));
+          if (!check_char() && (get_character_size() > 1 || isalnum(ch) || ch == '_'))
+          {
+            temp += ch;//EOF
+            ch = 0;
           }
-        };
-        do { get_multichar(); }
-        while (check_char() && (get_character_size() > 1 || isalnum(ch) || ch == '_'));
-        if (!check_char() && (get_character_size() > 1 || isalnum(ch) || ch == '_'))
-        {
-          temp += ch;//EOF
-          ch = 0;
         }
   
         if (temp == "end")
@@ -15,6 +15,7 @@
 #define LIBCZH_NODE_HPP
 #pragma once
 
+#include "path.hpp"
 #include "value.hpp"
 #include "writer.hpp"
 #include "error.hpp"
@@ -22,174 +23,566 @@
 #include "token.hpp"
 #include <iostream>
 #include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <string>
-#include <vector>
-#include <list>
+#include <bit>
+#include <functional>
+#include <iterator>
 #include <map>
 #include <memory>
+#include <memory_resource>
+#include <optional>
+#include <span>
+#include <string_view>
+#include <vector>
 #include <variant>
 #include <typeindex>
+#include <unordered_map>
 #include <typeinfo>
 
 using czh::value::Value;
+namespace czh::overlay
+{
+  class Overlay;
+}
 namespace czh::node
 {
   using Color = utils::Color;
   
+  class NodePool;
+  
+  namespace details
+  {
+    // Allows looking up std::string keys by std::string_view.
+    struct NameHash
+    {
+      using is_transparent = void;
+      
+      std::size_t operator()(std::string_view str) const
+      {
+        return path::hash(str);
+      }
+    };
+    
+    // Iterates over the children of a Node, which are stored as pointers.
+    template<typename Base, typename T>
+    class ChildIterator
+    {
+    private:
+      Base it;
+    public:
+      using iterator_category = std::random_access_iterator_tag;
+      using value_type = std::remove_const_t<T>;
+      using difference_type = std::ptrdiff_t;
+      using pointer = T *;
+      using reference = T &;
+      
+      ChildIterator() = default;
+      
+      explicit ChildIterator(Base it_) : it(it_) {}
+      
+      template<typename B, typename U>
+      requires std::is_convertible_v<B, Base>
+      ChildIterator(const ChildIterator<B, U> &i) : it(i.base()) {}
+      
+      [[nodiscard]] Base base() const { return it; }
+      
+      reference operator*() const { return **it; }
+      
+      pointer operator->() const { return it->get(); }
+      
+      reference operator[](difference_type n) const { return *it[n]; }
+      
+      ChildIterator &operator++()
+      {
+        ++it;
+        return *this;
+      }
+      
+      ChildIterator operator++(int) { return ChildIterator(it++); }
+      
+      ChildIterator &operator--()
+      {
+        --it;
+        return *this;
+      }
+      
+      ChildIterator operator--(int) { return ChildIterator(it--); }
+      
+      ChildIterator &operator+=(difference_type n)
+      {
+        it += n;
+        return *this;
+      }
+      
+      ChildIterator &operator-=(difference_type n)
+      {
+        it -= n;
+        return *this;
+      }
+      
+      friend ChildIterator operator+(ChildIterator i, difference_type n) { return i += n; }
+      
+      friend ChildIterator operator+(difference_type n, ChildIterator i) { return i += n; }
+      
+      friend ChildIterator operator-(ChildIterator i, difference_type n) { return i -= n; }
+      
+      friend difference_type operator-(const ChildIterator &a, const ChildIterator &b) { return a.it - b.it; }
+      
+      bool operator==(const ChildIterator &i) const { return it == i.it; }
+      
+      auto operator<=>(const ChildIterator &i) const { return it <=> i.it; }
+    };
+  }
+  
   class Node
   {
     friend std::ostream &operator<<(std::ostream &, const Node &);
+    friend class NodePool;
+    friend class overlay::Overlay;
 
   private:
+    // Frees a child in the memory resource it was allocated from.
+    struct Deleter
+    {
+      std::pmr::memory_resource *resource = nullptr;// nullptr for new and delete
+      
+      void operator()(Node *p) const
+      {
+        if (resource == nullptr)
+        {
+          delete p;
+          return;
+        }
+        p->~Node();
+        resource->deallocate(p, sizeof(Node), alignof(Node));
+      }
+    };
+    
+    // Maps the path of every Node in a tree, like "a::b::c", to the Node.
+    struct PathIndex
+    {
+      std::unordered_map<std::string, Node *, details::NameHash, std::equal_to<>> nodes;
+      // Set by the changes which are not tracked. A stale index is not used.
+      bool stale = false;
+    };
+    
+    // Refers to a Node which has children. The children refer to its anchor instead
+    // of the Node, so moving the Node only updates the anchor.
+    // The anchor of the root keeps its path index.
+    struct Anchor
+    {
+      Node *owner;
+      PathIndex *index;
+    };
+    
+    // The children are kept in insertion order. Each child is allocated on its own,
+    // so its address does not change when the vector grows. Small nodes are looked
+    // up by scanning the hashes, and large ones through an open addressing index.
+    // The children and the vectors are allocated in the same memory resource.
     class NodeData
     {
     public:
-      using IndexType = std::map<std::string, std::list<Node>::iterator>;
-      using NodeType = std::list<Node>;
-      IndexType index;
-      std::list<Node> nodes;
+      using NodeType = std::pmr::vector<std::unique_ptr<Node, Deleter>>;
+      static constexpr std::size_t npos = static_cast<std::size_t>(-1);
+      static constexpr std::size_t small_size = 8;
+      NodeType nodes;
+      std::pmr::vector<std::size_t> hashes;
+      // index + 1 of the child in the low 32 bits and the high 32 bits of its hash, so probing
+      // does not load `hashes`. 0 for an empty slot. Empty for small nodes, unless reserved.
+      std::pmr::vector<std::uint64_t> table;
+      // Allocated when the first child is added.
+      Anchor *anchor;
     public:
-      NodeData() = default;
-  
-      NodeData(const NodeData &nd)
+      NodeData() : anchor(nullptr) {}
+      
+      explicit NodeData(std::pmr::memory_resource *resource)
+          : nodes(resource), hashes(resource), table(resource), anchor(nullptr) {}
+      
+      ~NodeData()
       {
-        for (auto &r: nd.nodes)
+        if (anchor == nullptr) return;
+        if (anchor->index != nullptr)
         {
-          int e;
-          add(Node(r), "", e);
+          delete anchor->index;
+          indexed_trees.fetch_sub(1, std::memory_order_relaxed);
         }
+        resource()->deallocate(anchor, sizeof(Anchor), alignof(Anchor));
       }
   
-      NodeData(NodeData &&nd)
+      NodeData(const NodeData &nd) : anchor(nullptr)
       {
+        reserve(nd.nodes.size());
         for (auto &r: nd.nodes)
         {
           int e;
-          add(std::move(r), "", e);
+          add("", e, *r);
         }
       }
   
+      // The nodes are not moved, so their addresses do not change.
+      NodeData(NodeData &&nd) noexcept
+          : nodes(std::move(nd.nodes)), hashes(std::move(nd.hashes)), table(std::move(nd.table)), anchor(nd.anchor)
+      {
+        nd.anchor = nullptr;
+      }
+  
       template<typename T>
       requires (!std::is_base_of_v<NodeData, std::decay_t<T>>)
-      NodeData(const T &il)
+      NodeData(const T &il) : anchor(nullptr)
       {
+        reserve(std::size(il));
         for (auto &r: il)
         {
           int e;
-          add(Node(r), "", e);
+          add("", e, r);
         }
       }
       
-      [[nodiscard]]const auto &get_nodes() const { return nodes; }
-      
-      auto &get_nodes() { return nodes; }
-      
       bool operator==(const NodeData &nd) const
       {
-        return (nodes == nd.nodes);
+        return std::equal(nodes.cbegin(), nodes.cend(), nd.nodes.cbegin(), nd.nodes.cend(),
+                          [](auto &&a, auto &&b) { return *a == *b; });
       }
       
-      Node *add(Node node, const std::string &before, int &err)
+      // Constructs the Node with args.
+      template<typename ...Args>
+      Node *add(const std::string &before, int &err, Args &&...args)
       {
-        NodeType::iterator inserted;
+        auto pos = nodes.size();
         if (!before.empty())
         {
-          auto it = std::find_if(nodes.begin(), nodes.end(), [&before](auto &&n) { return n.get_name() == before; });
-          if (it == nodes.end())
+          pos = find(before);
+          if (pos == npos)
           {
             err = -1;
             return nullptr;
           }
-          inserted = nodes.insert(it, std::move(node));
         }
-        else
+        auto node = make(std::forward<Args>(args)...);
+        auto ret = node.get();
+        insert(pos, std::move(node));
+        err = 0;
+        return ret;
+      }
+      
+      template<typename ...Args>
+      std::unique_ptr<Node, Deleter> make(Args &&...args) const
+      {
+        auto res = resource();
+        if (res == std::pmr::new_delete_resource())
         {
-          inserted = nodes.insert(nodes.end(), std::move(node));
+          return std::unique_ptr<Node, Deleter>(new Node(std::forward<Args>(args)...));
+        }
+        auto mem = res->allocate(sizeof(Node), alignof(Node));
+        try
+        {
+          return std::unique_ptr<Node, Deleter>(new(mem) Node(std::forward<Args>(args)...), Deleter{res});
+        }
+        catch (...)
+        {
+          res->deallocate(mem, sizeof(Node), alignof(Node));
+          throw;
+        }
+      }
+      
+      [[nodiscard]] std::pmr::memory_resource *resource() const
+      {
+        return nodes.get_allocator().resource();
+      }
+      
+      Anchor *get_anchor(Node *owner)
+      {
+        if (anchor == nullptr)
+        {
+          anchor = new(resource()->allocate(sizeof(Anchor), alignof(Anchor))) Anchor{owner, nullptr};
+        }
+        return anchor;
+      }
+      
+      void set_owner(Node *owner)
+      {
+        if (anchor != nullptr) anchor->owner = owner;
+      }
+      
+      void insert(std::size_t pos, std::unique_ptr<Node, Deleter> node)
+      {
+        auto h = hash(node->name);
+        insert(pos, std::move(node), h);
+      }
+      
+      // `h` must be path::hash(node->name).
+      void insert(std::size_t pos, std::unique_ptr<Node, Deleter> node, std::size_t h)
+      {
+        if (nodes.capacity() == 0)
+        {
+          nodes.reserve(4);
+          hashes.reserve(4);
+        }
+        if (pos == nodes.size())
+        {
+          nodes.emplace_back(std::move(node));
+          hashes.emplace_back(h);
+          if (table.empty())
+          {
+            if (nodes.size() > small_size) reindex();
+          }
+          else if (nodes.size() * 2 > table.size()) reindex();
+          else place(nodes.size() - 1);
+          return;
+        }
+        nodes.insert(nodes.begin() + static_cast<std::ptrdiff_t>(pos), std::move(node));
+        hashes.insert(hashes.begin() + static_cast<std::ptrdiff_t>(pos), h);
+        reindex();
+      }
+      
+      // Makes room for `n` children, so that adding them neither moves the vectors nor
+      // rebuilds the index.
+      void reserve(std::size_t n)
+      {
+        nodes.reserve(n);
+        hashes.reserve(n);
+        if (n <= small_size || table.size() >= n * 2) return;
+        table.assign(std::bit_ceil(n * 2), 0);
+        for (std::size_t i = 0; i < nodes.size(); ++i)
+        {
+          place(i);
         }
-        // rbegin() -> end()
-        index[inserted->name] = inserted;
-        err = 0;
-        return &*inserted;
       }
       
       void erase(const std::string &tag)
       {
-        auto it = index.find(tag);
-        nodes.erase(it->second);
-        index.erase(it);
+        release(tag);
+      }
+      
+      // Takes the child out without destroying it.
+      std::unique_ptr<Node, Deleter> release(const std::string &tag)
+      {
+        auto pos = static_cast<std::ptrdiff_t>(find(tag));
+        auto ret = std::move(nodes[pos]);
+        nodes.erase(nodes.begin() + pos);
+        hashes.erase(hashes.begin() + pos);
+        reindex();
+        return ret;
       }
       
       void clear()
       {
         nodes.clear();
-        index.clear();
+        hashes.clear();
+        table.clear();
+      }
+      
+      // Both must use the same memory resource. The anchors are not swapped.
+      void swap(NodeData &nd) noexcept
+      {
+        nodes.swap(nd.nodes);
+        hashes.swap(nd.hashes);
+        table.swap(nd.table);
       }
       
       void rename(const std::string &oldname, const std::string &newname)
       {
-        auto n = index.extract(oldname);
-        n.key() = newname;
-        index.insert(std::move(n));
-        index[newname]->name = newname;
+        auto pos = find(oldname);
+        nodes[pos]->name = newname;
+        hashes[pos] = hash(newname);
+        reindex();
       }
       
-      [[nodiscard]]NodeData::IndexType::iterator find(const std::string &str)
+      // The index of the child named `str`, or npos. The last one wins if there are duplicates.
+      [[nodiscard]] std::size_t find(std::string_view str) const
       {
-        return index.find(str);
+        return find(str, hash(str));
       }
       
-      [[nodiscard]]auto end()
+      // `h` must be path::hash(str).
+      [[nodiscard]] std::size_t find(std::string_view str, std::size_t h) const
       {
-        return index.end();
+        if (table.empty())
+        {
+          for (auto i = nodes.size(); i-- > 0;)
+          {
+            if (hashes[i] == h && nodes[i]->name == str) return i;
+          }
+          return npos;
+        }
+        auto mask = table.size() - 1;
+        auto e = entry(0, h);
+        for (auto slot = h & mask; table[slot] != 0; slot = (slot + 1) & mask)
+        {
+          if (((table[slot] ^ e) >> 32) != 0) continue;
+          auto i = static_cast<std::size_t>(table[slot] & index_mask) - 1;
+          if (hashes[i] == h && nodes[i]->name == str) return i;
+        }
+        return npos;
       }
+  
+    private:
+      static constexpr std::uint64_t index_mask = 0xffffffff;
       
-      [[nodiscard]]NodeData::IndexType::const_iterator find(const std::string &str) const
+      static std::size_t hash(std::string_view str)
       {
-        return index.find(str);
+        return path::hash(str);
       }
       
-      [[nodiscard]]auto end() const
+      static std::uint64_t entry(std::size_t i, std::size_t h)
       {
-        return index.end();
+        return (static_cast<std::uint64_t>(h) & ~index_mask) | (i + 1);
+      }
+      
+      void reindex()
+      {
+        if (nodes.size() <= small_size)
+        {
+          table.clear();
+          return;
+        }
+        table.assign(std::bit_ceil(nodes.size() * 2), 0);
+        for (std::size_t i = 0; i < nodes.size(); ++i)
+        {
+          place(i);
+        }
+      }
+      
+      void place(std::size_t i)
+      {
+        auto mask = table.size() - 1;
+        auto e = entry(i, hashes[i]);
+        auto slot = hashes[i] & mask;
+        for (; table[slot] != 0; slot = (slot + 1) & mask)
+        {
+          if (((table[slot] ^ e) >> 32) != 0) continue;
+          auto j = static_cast<std::size_t>(table[slot] & index_mask) - 1;
+          if (hashes[j] == hashes[i] && nodes[j]->name == nodes[i]->name) break;
+        }
+        table[slot] = e;
       }
     };
 
   public:
-    using iterator = NodeData::NodeType::iterator;
-    using const_iterator = NodeData::NodeType::const_iterator;
-    using reverse_iterator = NodeData::NodeType::reverse_iterator;
-    using const_reverse_iterator = NodeData::NodeType::const_reverse_iterator;
+    using iterator = details::ChildIterator<NodeData::NodeType::iterator, Node>;
+    using const_iterator = details::ChildIterator<NodeData::NodeType::const_iterator, const Node>;
+    using reverse_iterator = std::reverse_iterator<iterator>;
+    using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+    
+    // The children of a Node as (name, view<T>()) pairs, which are not copied.
+    template<typename T>
+    class ValueRange
+    {
+    private:
+      using Base = NodeData::NodeType::const_iterator;
+      Base first;
+      Base last;
+      std::source_location loc;
+    public:
+      class iterator
+      {
+      private:
+        Base it;
+        std::source_location loc;
+      public:
+        using iterator_category = std::input_iterator_tag;
+        using value_type = std::pair<std::string_view, value::details::view_t<T>>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+        
+        iterator() = default;
+        
+        iterator(Base it_, const std::source_location &l) : it(it_), loc(l) {}
+        
+        reference operator*() const
+        {
+          return {(*it)->name, (*it)->template view<T>(loc)};
+        }
+        
+        iterator &operator++()
+        {
+          ++it;
+          return *this;
+        }
+        
+        iterator operator++(int)
+        {
+          auto ret = *this;
+          ++it;
+          return ret;
+        }
+        
+        bool operator==(const iterator &i) const { return it == i.it; }
+      };
+      
+      ValueRange(Base first_, Base last_, const std::source_location &l) : first(first_), last(last_), loc(l) {}
+      
+      [[nodiscard]] iterator begin() const { return {first, loc}; }
+      
+      [[nodiscard]] iterator end() const { return {last, loc}; }
+      
+      [[nodiscard]] std::size_t size() const { return last - first; }
+    };
   private:
+    // Bumped whenever a linked tree changes in a way that may invalidate the targets of references.
+    static inline std::atomic<std::uint64_t> generation{2};
+    static constexpr std::uint64_t linking = 1;
+    // The number of trees with a path index. Changes look for the index only if it is not 0.
+    static inline std::atomic<std::size_t> indexed_trees{0};
+    
     std::string name;
-    Node *last_node;
+    Anchor *parent_anchor;
     std::variant<NodeData, Value> data;
     token::Token czh_token;
+    // The final target of a reference, valid while ref_generation == generation. It is filled
+    // by link(), or by the first read after a change. Atomic, as const reads fill it.
+    mutable std::atomic<Node *> ref_target{nullptr};
+    mutable std::atomic<std::uint64_t> ref_generation{0};
+    // Whether the tree of this node may hold targets of references, so changing it must
+    // invalidate them. A tree is linked as a whole, and new nodes take it from their parent.
+    mutable std::atomic<bool> linked{false};
+    // The cached hash(), or 0 if it is not computed. If a Node has none, neither have its ancestors.
+    // The lowest bit tells whether the subtree holds a Reference.
+    mutable std::atomic<std::size_t> content_hash{0};
   public:
     Node(Node *node_ptr, std::string node_name, token::Token token)
-        : name(std::move(node_name)), last_node(node_ptr), czh_token(std::move(token)) { data.emplace<NodeData>(); }
+        : name(std::move(node_name)), parent_anchor(node_ptr == nullptr ? nullptr : node_ptr->anchor()),
+          czh_token(std::move(token))
+    {
+      data.emplace<NodeData>(node_ptr == nullptr ? std::pmr::get_default_resource() : node_ptr->resource());
+    }
   
     Node(Node *node_ptr, std::string node_name, Value val, token::Token token)
-        : name(std::move(node_name)), last_node(node_ptr), data(std::move(val)), czh_token(std::move(token)) {}
+        : name(std::move(node_name)), parent_anchor(node_ptr == nullptr ? nullptr : node_ptr->anchor()),
+          data(std::move(val)), czh_token(std::move(token)) {}
   
-    Node() : name(""), last_node(nullptr) { data.emplace<NodeData>(); }
+    Node() : name(""), parent_anchor(nullptr) { data.emplace<NodeData>(); }
   
-    explicit Node(const Node &node) : name(node.name), last_node(node.last_node), czh_token(node.czh_token),
-                                      data(node.data)
+    // A root whose Nodes are allocated in `resource`, which must outlive them.
+    explicit Node(std::pmr::memory_resource *resource) : name(""), parent_anchor(nullptr)
+    {
+      data.emplace<NodeData>(resource);
+    }
+  
+    explicit Node(const Node &node) : name(node.name), parent_anchor(node.parent_anchor), czh_token(node.czh_token),
+                                      data(node.data), content_hash(node.content_hash.load(std::memory_order_relaxed))
     {
       if (is_node())
       {
         auto &nd = std::get<NodeData>(data);
         for (auto &r: nd.nodes)
         {
-          r.last_node = this;
+          r->parent_anchor = anchor();
         }
       }
     }
   
     Node &operator=(const Node &v)
     {
-      name = v.name;
-      last_node = v.last_node;
+      if (linked.load(std::memory_order_relaxed)) invalidate_links();
+      index_stale();
+      hash_stale();
+      ref_generation.store(0, std::memory_order_relaxed);
+      // The name and the parent are kept, as this node stays where it is, and its parent
+      // finds it by its name.
       czh_token = token::Token(v.czh_token);
       if (v.is_node())
       {
@@ -197,8 +590,9 @@ namespace czh::node
         auto &nd = std::get<NodeData>(data);
         for (auto &r: nd.nodes)
         {
-          r.last_node = this;
+          r->parent_anchor = anchor();
         }
+        if (linked.load(std::memory_order_relaxed)) mark_subtree();
       }
       else
       {
@@ -208,51 +602,57 @@ namespace czh::node
     }
   
     Node(Node &&node)
-        : name(std::move(node.name)), last_node(std::move(node.last_node)), czh_token(std::move(node.czh_token)),
-          data(std::move(node.data))
+        : name(std::move(node.name)), parent_anchor(node.parent_anchor), czh_token(std::move(node.czh_token)),
+          data(std::move(node.data)), linked(node.linked.load(std::memory_order_relaxed)),
+          content_hash(node.content_hash.load(std::memory_order_relaxed))
     {
-      if (is_node())
+      // Moving a node out of a tree is like removing it.
+      if (parent_anchor != nullptr)
       {
-        auto &nd = std::get<NodeData>(data);
-        for (auto &r: nd.nodes)
-        {
-          r.last_node = this;
-        }
+        if (linked.load(std::memory_order_relaxed)) invalidate_links();
+        parent_anchor->owner->hash_stale();
+        index_stale();
       }
+      // The children refer to the anchor, so this is O(1).
+      if (is_node()) std::get<NodeData>(data).set_owner(this);
     }
   
     template<typename T>
     requires (!std::is_base_of_v<Node, std::decay_t<T>>)
-    Node(std::string name_, T &&v): name(std::move(name_)), last_node(nullptr)
+    Node(std::string name_, T &&v): name(std::move(name_)), parent_anchor(nullptr)
     {
       data.emplace<Value>(v);
     }
   
-    Node(std::string name_, std::initializer_list<Node> v) : name(std::move(name_)), last_node(nullptr)
+    Node(std::string name_, std::initializer_list<Node> v) : name(std::move(name_)), parent_anchor(nullptr)
     {
       data.emplace<NodeData>(v);
       auto &nd = std::get<NodeData>(data);
       for (auto &r: nd.nodes)
       {
-        r.last_node = this;
+        r->parent_anchor = anchor();
       }
     }
   
-    Node(std::initializer_list<Node> v) : last_node(nullptr)
+    Node(std::initializer_list<Node> v) : parent_anchor(nullptr)
     {
       data.emplace<NodeData>(v);
       auto &nd = std::get<NodeData>(data);
       for (auto &r: nd.nodes)
       {
-        r.last_node = this;
+        r->parent_anchor = anchor();
       }
     }
   
     // Node and Value
+    // Keeps the memory resource of the Node.
     Node &reset()
     {
-      data.emplace<NodeData>();
-      last_node = nullptr;
+      if (linked.load(std::memory_order_relaxed)) invalidate_links();
+      hash_stale();
+      index_stale();
+      data.emplace<NodeData>(resource());
+      parent_anchor = nullptr;
       name = "";
       return *this;
     }
@@ -265,19 +665,58 @@ namespace czh::node
     bool operator==(const Node &n) const
     {
       if (name != n.name) return false;
+      // Different hashes tell that the contents differ, without comparing them.
+      auto h = content_hash.load(std::memory_order_relaxed);
+      auto nh = n.content_hash.load(std::memory_order_relaxed);
+      if (h != 0 && nh != 0 && h != nh) return false;
       if (!is_node())
       {
         auto &v = std::get<Value>(data);
         if (v.is<value::Reference>())
         {
           if (!n.is<value::Reference>()) return false;
-          return get_ref(v.get<value::Reference>())->get_path() ==
-                 n.get_last_node()->get_ref(n.get<value::Reference>())->get_path();
+          return same_path(get_ref(v.view<value::Reference>()),
+                           n.get_last_node()->get_ref(
+                               std::get<Value>(n.data).view<value::Reference>()));
         }
       }
       return data == n.data;
     }
   
+    // A hash of the names and the values, computed bottom-up on the first call and cached
+    // until the subtree changes. Nodes written the same have equal hashes, so a reloaded
+    // config whose hash is unchanged need not be compared further, unless it holds a Reference.
+    // References are equal if their targets are, however they are written, so they all hash
+    // the same, and the lowest bit tells that equal hashes still need operator==.
+    // Changing a Value through a reference kept from get_value() is not tracked.
+    [[nodiscard]] std::size_t hash() const
+    {
+      auto h = content_hash.load(std::memory_order_relaxed);
+      if (h != 0) return h;
+      h = path::hash(name);
+      std::size_t refs = 0;
+      if (is_node())
+      {
+        for (auto &r: std::get<NodeData>(data).nodes)
+        {
+          auto child = r->hash();
+          h = value::details::hash_combine(h, child);
+          refs |= child & 1;
+        }
+      }
+      else
+      {
+        refs = is_reference();
+        auto v = refs ? value::details::index_of_v<value::Reference, value::details::VTList>
+                      : std::get<Value>(data).hash();
+        h = value::details::hash_combine(h, v);
+      }
+      h = (h & ~std::size_t(1)) | refs;
+      if (h == 0) h = 2;
+      content_hash.store(h, std::memory_order_relaxed);
+      return h;
+    }
+    
     [[nodiscard]]std::string get_name() const
     {
       return name;
@@ -286,30 +725,79 @@ namespace czh::node
     Node &remove(const std::source_location &l =
     std::source_location::current())
     {
-      assert_true(last_node, "Can not remove root.", czh_token, l);
-      auto &nd = std::get<NodeData>(last_node->data);
+      assert_true(get_last_node(), "Can not remove root.", czh_token, l);
+      if (linked.load(std::memory_order_relaxed)) invalidate_links();
+      index_remove();
+      get_last_node()->hash_stale();
+      auto &nd = std::get<NodeData>(get_last_node()->data);
       nd.erase(name);
       return *this;
     }
   
+    // Moves this Node with its subtree to the end of `parent`, or before the node named `before`.
+    // The subtree is not copied, so it costs the same for any size, and references to
+    // its Nodes stay valid. Both parents must use the same memory resource.
+    Node &move_to(Node &parent, const std::string &before = "", const std::source_location &l =
+    std::source_location::current())
+    {
+      assert_true(get_last_node(), "Can not move root.", czh_token, l);
+      parent.assert_node(l);
+      for (auto p = &parent; p != nullptr; p = p->get_last_node())
+      {
+        assert_true(p != this, "Can not move a Node into itself.", czh_token, l);
+      }
+      auto &from = std::get<NodeData>(get_last_node()->data);
+      auto &to = std::get<NodeData>(parent.data);
+      assert_true(from.resource() == to.resource(), "Can not move a Node to another memory resource.", czh_token, l);
+      assert_true(&parent == get_last_node() || to.find(name) == NodeData::npos, "Duplicate node name.", czh_token, l);
+      if (!before.empty() && to.find(before) == NodeData::npos) parent.report_no_node(before, l);
+      if (before == name) return *this;
+      if (linked.load(std::memory_order_relaxed) || parent.linked.load(std::memory_order_relaxed))
+      {
+        invalidate_links();
+      }
+      index_remove();
+      get_last_node()->hash_stale();
+      parent.hash_stale();
+      auto self = from.release(name);
+      parent_anchor = parent.anchor();
+      to.insert(before.empty() ? to.nodes.size() : to.find(before), std::move(self));
+      index_add();
+      if (parent.linked.load(std::memory_order_relaxed) && !linked.load(std::memory_order_relaxed)) mark_subtree();
+      return *this;
+    }
+  
     Node &rename(const std::string &newname, const std::source_location &l =
     std::source_location::current())
     {
-      if (last_node == nullptr)
+      if (linked.load(std::memory_order_relaxed)) invalidate_links();
+      hash_stale();
+      if (get_last_node() == nullptr)
       {
         name = newname;
         return *this;
       }
-      auto &nd = std::get<NodeData>(last_node->data);
-      auto it = nd.index.find(newname);
-      assert_true(it == nd.index.end(), "Duplicate node name.", czh_token, l);
+      auto &nd = std::get<NodeData>(get_last_node()->data);
+      assert_true(nd.find(newname) == NodeData::npos, "Duplicate node name.", czh_token, l);
+      index_remove();
       nd.rename(name, newname);
+      index_add();
       return *this;
     }
   
     [[nodiscard]] Node *get_last_node() const
     {
-      return last_node;
+      return parent_anchor == nullptr ? nullptr : parent_anchor->owner;
+    }
+    
+    [[nodiscard]] const token::Token &get_token() const
+    {
+      return czh_token;
+    }
+    
+    [[nodiscard]] token::Token &get_token()
+    {
+      return czh_token;
     }
     
     [[nodiscard]] std::vector<std::string> get_path() const
@@ -325,6 +813,58 @@ namespace czh::node
       return res;
     }
   
+  private:
+    // get_path().size(), without building it.
+    [[nodiscard]] static std::size_t path_depth(const Node *n)
+    {
+      std::size_t depth = 1;
+      for (n = n->get_last_node(); n != nullptr && !n->name.empty(); n = n->get_last_node()) ++depth;
+      return depth;
+    }
+    
+    // get_path() of a == get_path() of b, without building them.
+    [[nodiscard]] static bool same_path(const Node *a, const Node *b)
+    {
+      if (a->name != b->name) return false;
+      while (true)
+      {
+        a = a->get_last_node();
+        b = b->get_last_node();
+        bool a_end = a == nullptr || a->name.empty();
+        bool b_end = b == nullptr || b->name.empty();
+        if (a_end || b_end) return a_end == b_end;
+        if (a->name != b->name) return false;
+      }
+    }
+    
+    // The length of the common prefix of get_path() of a and b from the outermost name,
+    // given their depths.
+    [[nodiscard]] static std::size_t common_path_depth(const Node *a, std::size_t a_depth,
+                                                       const Node *b, std::size_t b_depth)
+    {
+      for (; a_depth > b_depth; --a_depth) a = a->get_last_node();
+      for (; b_depth > a_depth; --b_depth) b = b->get_last_node();
+      // Walks up both, so the last mismatch seen is the outermost one.
+      auto common = a_depth;
+      for (auto level = a_depth; level > 0; --level)
+      {
+        if (a->name != b->name) common = level - 1;
+        a = a->get_last_node();
+        b = b->get_last_node();
+      }
+      return common;
+    }
+    
+    // Writes the names of the `count` innermost Nodes of the path of n, from the outermost.
+    template<writer::Writer W>
+    static void write_ref_path(W &writer, const Node *n, std::size_t count)
+    {
+      if (count == 0) return;
+      write_ref_path(writer, n->get_last_node(), count - 1);
+      writer.value_ref_path(n->name);
+    }
+  
+  public:
     template<writer::Writer W>
     const Node &accept(W &writer) const
     {
@@ -337,7 +877,7 @@ namespace czh::node
         auto &nd = std::get<NodeData>(data);
         for (auto &r: nd.nodes)
         {
-          r.accept(writer);
+          r->accept(writer);
         }
         if (!name.empty())
         {
@@ -350,41 +890,26 @@ namespace czh::node
         writer.value_begin(name);
         if (value.is<value::Reference>())
         {
-          auto path = get_ref(value.get<value::Reference>())->get_path();
-          auto this_path = get_last_node()->get_path();
-          auto[itpath, itthis] = std::mismatch(path.rbegin(), path.rend(),
-                                               this_path.rbegin(), this_path.rend());
-          if (itpath == path.rend() && itthis == this_path.rend())
+          // The path of the target is written from where it leaves the path of this
+          // Node's parent. Both are walked in place instead of being copied by get_path().
+          auto target = get_ref(value.view<value::Reference>());
+          auto parent = get_last_node();
+          auto target_depth = path_depth(target);
+          auto parent_depth = path_depth(parent);
+          auto common = common_path_depth(target, target_depth, parent, parent_depth);
+          if (common == target_depth && common == parent_depth)
           {
             writer.value_ref_path_set_global();
           }
-          for (; itpath < path.rend() - 1; ++itpath)
+          if (common + 1 < target_depth)
           {
-            writer.value_ref_path(*itpath);
-          }
-          writer.value_ref_id(path[0]);
-        }
-        else if (value.is<value::Array>())
-        {
-          auto arr = value.get<value::Array>();
-          writer.value_array_begin();
-          for (auto it = arr.cbegin(); it < arr.cend(); ++it)
-          {
-            if (it + 1 == arr.cend()) break;
-            writer.value_array_value(*it);
-          }
-          if (!arr.empty())
-          {
-            writer.value_array_end(*arr.crbegin());
-          }
-          else
-          {
-            writer.value_array_end();
+            write_ref_path(writer, target->get_last_node(), target_depth - 1 - common);
           }
+          writer.value_ref_id(target->name);
         }
         else
         {
-          writer.value(value);
+          writer::accept_value(writer, value);
         }
       }
       return *this;
@@ -394,17 +919,24 @@ namespace czh::node
     requires (!std::is_base_of_v<Node, std::decay_t<T>>)
     Node &operator=(T &&v)
     {
-      if (is_node()) data.template emplace<Value>();
+      if (is_node())
+      {
+        if (linked.load(std::memory_order_relaxed)) invalidate_links();
+        index_remove_children();
+        data.template emplace<Value>();
+      }
       auto &value = std::get<Value>(data);
       if (value.is<value::Reference>())
       {
-        auto ptr = get_end_of_list_of_ref(value.get<value::Reference>());
+        auto ptr = ref_end(std::source_location::current());
         assert_true(ptr != nullptr, "Can not get a circular reference.", czh_token);
         *ptr = std::forward<T>(v);
       }
       else
       {
+        hash_stale();
         value = std::forward<T>(v);
+        if (value.is<value::Reference>() && linked.load(std::memory_order_relaxed)) invalidate_links();
       }
       return *this;
     }
@@ -412,7 +944,13 @@ namespace czh::node
     template<typename T>
     Node &operator=(std::initializer_list<T> &&il)
     {
-      if (is_node()) data.template emplace<Value>();
+      hash_stale();
+      if (is_node())
+      {
+        if (linked.load(std::memory_order_relaxed)) invalidate_links();
+        index_remove_children();
+        data.template emplace<Value>();
+      }
       auto &value = std::get<Value>(data);
       value = std::forward<std::initializer_list<T>>(il);
       return *this;
@@ -420,7 +958,13 @@ namespace czh::node
   
     Node &operator=(const value::Array &v)
     {
-      if (is_node()) data.template emplace<Value>();
+      hash_stale();
+      if (is_node())
+      {
+        if (linked.load(std::memory_order_relaxed)) invalidate_links();
+        index_remove_children();
+        data.template emplace<Value>();
+      }
       auto &value = std::get<Value>(data);
       value = v;
       return *this;
@@ -428,12 +972,12 @@ namespace czh::node
   
   
     // Node only
-    [[nodiscard]] bool has_node(const std::string &tag, const std::source_location &l =
+    [[nodiscard]] bool has_node(std::string_view tag, const std::source_location &l =
     std::source_location::current()) const
     {
       assert_node(l);
       auto &nd = std::get<NodeData>(data);
-      return (nd.find(tag) != nd.end());
+      return nd.find(tag) != NodeData::npos;
     }
   
     [[nodiscard]]iterator begin(const std::source_location &l =
@@ -441,7 +985,7 @@ namespace czh::node
     {
       assert_node(l);
       auto &nd = std::get<NodeData>(data);
-      return nd.nodes.begin();
+      return iterator(nd.nodes.begin());
     }
   
     [[nodiscard]]iterator end(const std::source_location &l =
@@ -449,7 +993,7 @@ namespace czh::node
     {
       assert_node(l);
       auto &nd = std::get<NodeData>(data);
-      return nd.nodes.end();
+      return iterator(nd.nodes.end());
     }
   
     [[nodiscard]]reverse_iterator rbegin(const std::source_location &l =
@@ -457,7 +1001,7 @@ namespace czh::node
     {
       assert_node(l);
       auto &nd = std::get<NodeData>(data);
-      return nd.nodes.rbegin();
+      return reverse_iterator(iterator(nd.nodes.end()));
     }
   
     [[nodiscard]]reverse_iterator rend(const std::source_location &l =
@@ -465,7 +1009,7 @@ namespace czh::node
     {
       assert_node(l);
       auto &nd = std::get<NodeData>(data);
-      return nd.nodes.rend();
+      return reverse_iterator(iterator(nd.nodes.begin()));
     }
   
     [[nodiscard]]const_iterator cbegin(const std::source_location &l =
@@ -473,7 +1017,7 @@ namespace czh::node
     {
       assert_node(l);
       auto &nd = std::get<NodeData>(data);
-      return nd.nodes.cbegin();
+      return const_iterator(nd.nodes.cbegin());
     }
   
     [[nodiscard]]const_iterator cend(const std::source_location &l =
@@ -481,7 +1025,7 @@ namespace czh::node
     {
       assert_node(l);
       auto &nd = std::get<NodeData>(data);
-      return nd.nodes.cend();
+      return const_iterator(nd.nodes.cend());
     }
   
     [[nodiscard]]const_reverse_iterator crbegin(const std::source_location &l =
@@ -489,7 +1033,7 @@ namespace czh::node
     {
       assert_node(l);
       auto &nd = std::get<NodeData>(data);
-      return nd.nodes.crbegin();
+      return const_reverse_iterator(const_iterator(nd.nodes.cend()));
     }
   
     [[nodiscard]]const_reverse_iterator crend(const std::source_location &l =
@@ -497,13 +1041,26 @@ namespace czh::node
     {
       assert_node(l);
       auto &nd = std::get<NodeData>(data);
-      return nd.nodes.crend();
+      return const_reverse_iterator(const_iterator(nd.nodes.cbegin()));
+    }
+  
+    // Makes room for `n` children, so that adding them neither moves the children list
+    // nor rebuilds the index of their names. Worth it before adding many children.
+    Node &reserve(std::size_t n, const std::source_location &l =
+    std::source_location::current())
+    {
+      assert_node(l);
+      std::get<NodeData>(data).reserve(n);
+      return *this;
     }
   
     Node &clear(const std::source_location &l =
     std::source_location::current())
     {
       assert_node(l);
+      if (linked.load(std::memory_order_relaxed)) invalidate_links();
+      hash_stale();
+      index_remove_children();
       auto &nd = std::get<NodeData>(data);
       nd.clear();
       return *this;
@@ -515,11 +1072,14 @@ namespace czh::node
               std::source_location::current())
     {
       assert_node(l);
+      if (linked.load(std::memory_order_relaxed)) invalidate_links();
+      hash_stale();
       auto &nd = std::get<NodeData>(data);
       int err = 0;
-      auto ret = nd.add(Node(this, std::move(add_name), Value(std::forward<T>(_value)), std::move(token)), before,
-                        err);
+      auto ret = nd.add(before, err, this, std::move(add_name), Value(std::forward<T>(_value)), std::move(token));
       if (err != 0) report_no_node(before, l);
+      ret->linked.store(linked.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      ret->index_add();
       return *ret;
     }
     
@@ -533,13 +1093,51 @@ namespace czh::node
                    std::source_location::current())
     {
       assert_node(l);
+      if (linked.load(std::memory_order_relaxed)) invalidate_links();
+      hash_stale();
       auto &nd = std::get<NodeData>(data);
       int err = 0;
-      auto ret = nd.add(Node(this, std::move(add_name), std::move(token)), before, err);
+      auto ret = nd.add(before, err, this, std::move(add_name), std::move(token));
       if (err != 0) report_no_node(before, l);
+      ret->linked.store(linked.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      ret->index_add();
       return *ret;
     }
   
+    // Moves all the nodes in `node` to the end of this Node.
+    Node &splice(Node &&node, const std::source_location &l =
+    std::source_location::current())
+    {
+      assert_node(l);
+      node.assert_node(l);
+      bool was_linked = linked.load(std::memory_order_relaxed);
+      if (was_linked || node.linked.load(std::memory_order_relaxed)) invalidate_links();
+      hash_stale();
+      node.hash_stale();
+      auto &nd = std::get<NodeData>(data);
+      auto &from = std::get<NodeData>(node.data);
+      for (std::size_t i = 0; i < from.nodes.size(); ++i)
+      {
+        if (nd.find(from.nodes[i]->name, from.hashes[i]) != NodeData::npos)
+        {
+          from.nodes[i]->czh_token.report_error("Duplicate node name.");
+        }
+      }
+      nd.reserve(nd.nodes.size() + from.nodes.size());
+      for (std::size_t i = 0; i < from.nodes.size(); ++i)
+      {
+        auto &r = from.nodes[i];
+        r->parent_anchor = anchor();
+        r->index_add();
+        if (was_linked && !r->linked.load(std::memory_order_relaxed)) r->mark_subtree();
+        nd.insert(nd.nodes.size(), std::move(r), from.hashes[i]);
+      }
+      from.clear();
+      node.index_stale();
+      return *this;
+    }
+  
+    // Copies every name and value. values<T>() does not.
     template<typename T>
     std::map<std::string, T> value_map(const std::source_location &l =
     std::source_location::current())
@@ -547,40 +1145,156 @@ namespace czh::node
       assert_node(l);
       std::map<std::string, T> result;
       auto &nd = std::get<NodeData>(data);
-      for (auto &r: nd.get_nodes())
+      for (auto &r: nd.nodes)
       {
-        auto pval = std::get_if<value::Value>(&r.data);
+        auto pval = std::get_if<value::Value>(&r->data);
         assert_true(pval, "This Node must only contain value.", czh_token, l);
-        result[r.name] = pval->get<T>();
+        result[r->name] = pval->get<T>();
       }
       return result;
     }
+    
+    // Views each child as view<T>() while iterating, so the children must all be values
+    // of T, or references to them. Changing the Node invalidates the range.
+    template<value::CzhViewType T>
+    [[nodiscard]] ValueRange<T> values(const std::source_location &l =
+    std::source_location::current()) const
+    {
+      assert_node(l);
+      auto &nd = std::get<NodeData>(data);
+      return {nd.nodes.cbegin(), nd.nodes.cend(), l};
+    }
   
-    const Node &operator()(const std::string &s, const std::source_location &l =
+    const Node &operator()(std::string_view s, const std::source_location &l =
     std::source_location::current()) const
     {
       assert_node(l);
       auto &nd = std::get<NodeData>(data);
-      auto it = nd.find(s);
-      if (it == nd.end()) report_no_node(s, l);
-      return *it->second;
+      auto pos = nd.find(s);
+      if (pos == NodeData::npos) report_no_node(std::string(s), l);
+      return *nd.nodes[pos];
     }
   
-    Node &operator()(const std::string &s, const std::source_location &l =
+    Node &operator()(std::string_view s, const std::source_location &l =
     std::source_location::current())
     {
-      return const_cast<Node &>(const_cast<const Node &>(*this)(s));
+      return const_cast<Node &>(const_cast<const Node &>(*this)(s, l));
     }
   
-    Node &operator[](const std::string &s)
+    Node &operator[](std::string_view s)
     {
       return operator()(s);
     }
   
-    const Node &operator[](const std::string &s) const
+    const Node &operator[](std::string_view s) const
     {
       return operator()(s);
     }
+    
+    // The child named `name`, or nullptr if there is none or this Node is a value.
+    // Unlike operator[], it never reports an error.
+    [[nodiscard]] const Node *find(std::string_view name) const
+    {
+      if (!is_node()) return nullptr;
+      auto &nd = std::get<NodeData>(data);
+      auto pos = nd.find(name);
+      return pos == NodeData::npos ? nullptr : nd.nodes[pos].get();
+    }
+    
+    [[nodiscard]] Node *find(std::string_view name)
+    {
+      return const_cast<Node *>(const_cast<const Node &>(*this).find(name));
+    }
+    
+    // Like at(), but returns nullptr if the path does not exist.
+    [[nodiscard]] const Node *find(const path::Path &p) const
+    {
+      auto n = p.is_global() ? root() : this;
+      if (auto found = n->find_indexed(p)) return found;
+      for (auto &seg: p)
+      {
+        if (!n->is_node()) return nullptr;
+        auto &nd = std::get<NodeData>(n->data);
+        auto pos = nd.find(seg.name, seg.hash);
+        if (pos == NodeData::npos) return nullptr;
+        n = nd.nodes[pos].get();
+      }
+      return n;
+    }
+    
+    [[nodiscard]] Node *find(const path::Path &p)
+    {
+      return const_cast<Node *>(const_cast<const Node &>(*this).find(p));
+    }
+    
+    // Looks up a precompiled path from this Node, or from the root if it is global.
+    const Node &at(const path::Path &p, const std::source_location &l =
+    std::source_location::current()) const
+    {
+      auto n = p.is_global() ? root() : this;
+      if (auto found = n->find_indexed(p)) return *found;
+      for (auto &seg: p)
+      {
+        n->assert_node(l);
+        auto &nd = std::get<NodeData>(n->data);
+        auto pos = nd.find(seg.name, seg.hash);
+        if (pos == NodeData::npos) n->report_no_node(seg.name, l);
+        n = nd.nodes[pos].get();
+      }
+      return *n;
+    }
+    
+    Node &at(const path::Path &p, const std::source_location &l =
+    std::source_location::current())
+    {
+      return const_cast<Node &>(const_cast<const Node &>(*this).at(p, l));
+    }
+    
+    template<typename T>
+    T get(const path::Path &p, const std::source_location &l =
+    std::source_location::current()) const
+    {
+      return at(p, l).template get<T>(l);
+    }
+    
+    // Returns nothing if the path does not exist. See try_get<T>().
+    template<typename T>
+    std::optional<T> try_get(const path::Path &p) const
+    {
+      auto n = find(p);
+      if (n == nullptr) return std::nullopt;
+      return n->template try_get<T>();
+    }
+    
+    // Like get<T>(), but returns nothing instead of reporting an error, if this Node is
+    // not a value of T, or is an unknown or circular reference.
+    template<typename T>
+    std::optional<T> try_get() const
+    {
+      if (is_node()) return std::nullopt;
+      auto n = this;
+      if (is_reference() && !std::is_same_v<T, value::Reference>)
+      {
+        n = ref_end<false>(std::source_location::current());
+        if (n == nullptr || n->is_node()) return std::nullopt;
+      }
+      auto &value = std::get<Value>(n->data);
+      if (!value.can_get<T>()) return std::nullopt;
+      return value.get<T>();
+    }
+    
+    // Like view<T>() of a basic type, without any check: this Node must be a value of T,
+    // or a known reference to one.
+    template<value::CzhViewType T>
+    [[nodiscard]] const T &get_unchecked() const
+    {
+      auto n = this;
+      if constexpr (!std::is_same_v<T, value::Reference>)
+      {
+        if (is_reference()) n = ref_end<false>(std::source_location::current());
+      }
+      return *std::get_if<T>(&value::details::stored(*std::get_if<Value>(&n->data)));
+    }
   
     //Value only
     template<typename T>
@@ -592,8 +1306,17 @@ namespace czh::node
       return val.is<T>();
     }
   
+    // The Value may be changed through the result, so the cached hashes are dropped.
     Value &get_value(const std::source_location &l =
     std::source_location::current())
+    {
+      assert_value(l);
+      hash_stale();
+      return std::get<Value>(data);
+    }
+    
+    [[nodiscard]] const Value &get_value(const std::source_location &l =
+    std::source_location::current()) const
     {
       assert_value(l);
       return std::get<Value>(data);
@@ -607,9 +1330,10 @@ namespace czh::node
       auto &value = std::get<Value>(data);
       if (value.is<value::Reference>() && typeid(T) != typeid(value::Reference))
       {
-        auto ptr = get_end_of_list_of_ref(value.get<value::Reference>(), l);
-        assert_true(ptr != nullptr, "Can not get a circular reference.", czh_token, l);
-        return ptr->get<T>();
+        auto ptr = ref_end(l);
+        // Not assert_true(), which would build the message on every read.
+        if (ptr == nullptr) report_error("Can not get a circular reference.", czh_token, l);
+        return ptr->get<T>(l);
       }
   
       if (!value.can_get<T>())
@@ -619,58 +1343,344 @@ namespace czh::node
       }
       return value.get<T>();
     }
+    
+    
+    // Like get<T>(), but returns a reference to the value, or a std::span<const E> over a
+    // packed Array of E, instead of a copy. See Value::view().
+    template<value::CzhViewType T>
+    [[nodiscard]] value::details::view_t<T> view(const std::source_location &l =
+    std::source_location::current()) const
+    {
+      assert_value(l);
+      auto &value = std::get<Value>(data);
+      if (value.is<value::Reference>() && !std::is_same_v<T, value::Reference>)
+      {
+        auto ptr = ref_end(l);
+        if (ptr == nullptr) report_error("Can not get a circular reference.", czh_token, l);
+        return ptr->view<T>(l);
+      }
+      return value.view<T>(l);
+    }
 
 
+    // Resolves every reference in this Node to its final target, so reading a reference
+    // costs the same as reading a value. Circular and unknown references are reported at
+    // their tokens. The targets are dropped when the tree is modified, and each reference
+    // is resolved by its path again on its next read, which caches the target until the
+    // next change.
+    // Changing a reference through get_value() is not tracked, and needs another link().
+    Node &link(const std::source_location &l =
+    std::source_location::current())
+    {
+      assert_node(l);
+      mark_linked();
+      link_refs(generation.load(std::memory_order_relaxed), l);
+      return *this;
+    }
+    
+    // Indexes the path of every Node in this tree, so that looking up a Path from the root
+    // is one hash probe. The index is kept up to date by add, add_node, remove, rename,
+    // move_to, splice and clear. Other changes to the structure drop it until it is built again.
+    Node &build_index(const std::source_location &l =
+    std::source_location::current())
+    {
+      assert_true(get_last_node() == nullptr, "Only the root can be indexed.", czh_token, l);
+      assert_node(l);
+      auto a = anchor();
+      if (a->index == nullptr)
+      {
+        a->index = new PathIndex;
+        indexed_trees.fetch_add(1, std::memory_order_relaxed);
+      }
+      a->index->nodes.clear();
+      a->index->stale = false;
+      for (auto &r: std::get<NodeData>(data).nodes)
+      {
+        r->index_subtree(*a->index, r->name, true);
+      }
+      return *this;
+    }
+    
+    Node &drop_index()
+    {
+      auto r = const_cast<Node *>(root());
+      if (!r->is_node()) return *this;
+      auto a = std::get<NodeData>(r->data).anchor;
+      if (a != nullptr && a->index != nullptr)
+      {
+        delete a->index;
+        a->index = nullptr;
+        indexed_trees.fetch_sub(1, std::memory_order_relaxed);
+      }
+      return *this;
+    }
+  
   private:
+    [[nodiscard]] std::pmr::memory_resource *resource() const
+    {
+      if (is_node()) return std::get<NodeData>(data).resource();
+      return get_last_node() == nullptr ? std::pmr::get_default_resource() : get_last_node()->resource();
+    }
+    
+    [[nodiscard]] const Node *root() const
+    {
+      auto n = this;
+      while (n->get_last_node() != nullptr) n = n->get_last_node();
+      return n;
+    }
+    
+    // The path index of the tree of this Node, if there is one and it is not stale.
+    [[nodiscard]] PathIndex *find_index() const
+    {
+      if (indexed_trees.load(std::memory_order_relaxed) == 0) return nullptr;
+      auto r = root();
+      if (!r->is_node()) return nullptr;
+      auto a = std::get<NodeData>(r->data).anchor;
+      if (a == nullptr || a->index == nullptr || a->index->stale) return nullptr;
+      return a->index;
+    }
+    
+    // The path of this Node from the root, like "a::b::c".
+    [[nodiscard]] std::string path_key() const
+    {
+      std::string ret;
+      auto p = get_last_node();
+      if (p != nullptr && p->get_last_node() != nullptr) ret = p->path_key() + "::";
+      return ret + name;
+    }
+    
+    void index_subtree(PathIndex &index, const std::string &key, bool add)
+    {
+      if (add) index.nodes.insert_or_assign(key, this);
+      else index.nodes.erase(key);
+      if (!is_node()) return;
+      for (auto &r: std::get<NodeData>(data).nodes)
+      {
+        r->index_subtree(index, key + "::" + r->name, add);
+      }
+    }
+    
+    // Called after this Node is added to a tree.
+    void index_add()
+    {
+      if (auto index = find_index()) index_subtree(*index, path_key(), true);
+    }
+    
+    // Called before this Node is taken out of a tree.
+    void index_remove()
+    {
+      if (auto index = find_index()) index_subtree(*index, path_key(), false);
+    }
+    
+    void index_remove_children()
+    {
+      if (!is_node() || find_index() == nullptr) return;
+      for (auto &r: std::get<NodeData>(data).nodes) r->index_remove();
+    }
+    
+    // Looks up `p` in the path index, if this is the root and it has one.
+    [[nodiscard]] const Node *find_indexed(const path::Path &p) const
+    {
+      if (get_last_node() != nullptr || p.size() == 0) return nullptr;
+      auto index = find_index();
+      if (index == nullptr) return nullptr;
+      auto it = index->nodes.find(p.key());
+      return it == index->nodes.end() ? nullptr : it->second;
+    }
+    
+    // Drops the cached hashes of this Node and its ancestors. Stops at the first Node
+    // without one, as its ancestors have none either.
+    void hash_stale() const
+    {
+      for (auto n = this; n != nullptr && n->content_hash.load(std::memory_order_relaxed) != 0;
+           n = n->get_last_node())
+      {
+        n->content_hash.store(0, std::memory_order_relaxed);
+      }
+    }
+    
+    // Called on the changes which are not tracked.
+    void index_stale() const
+    {
+      if (auto index = find_index()) index->stale = true;
+    }
+    
+    // What the children of this Node refer to.
+    Anchor *anchor()
+    {
+      return std::get<NodeData>(data).get_anchor(this);
+    }
+    
+    [[nodiscard]] bool is_reference() const
+    {
+      return !is_node() && std::get<Value>(data).is<value::Reference>();
+    }
+    
+    void link_refs(std::uint64_t gen, const std::source_location &l)
+    {
+      for (auto &r: std::get<NodeData>(data).nodes)
+      {
+        if (r->is_node()) r->link_refs(gen, l);
+        else if (r->is_reference()) r->link_chain(gen, l);
+      }
+    }
+    
+    // Each reference has only one edge, so following every chain once
+    // resolves the whole graph in O(V+E). The chain is walked twice instead
+    // of being stored, so linking does not allocate.
+    void link_chain(std::uint64_t gen, const std::source_location &l)
+    {
+      auto next = [&l](Node *n)
+      {
+        return n->get_ref(std::get<Value>(n->data).view<value::Reference>(), l);
+      };
+      Node *curr = this;
+      try
+      {
+        while (curr->is_reference() && curr->ref_generation != gen)
+        {
+          if (curr->ref_generation == linking)
+          {
+            report_error("Circular reference.", curr->czh_token, l);
+          }
+          curr->ref_generation = linking;
+          curr = next(curr);
+        }
+      }
+      catch (...)
+      {
+        for (auto c = this; c->ref_generation == linking;)
+        {
+          c->ref_generation = 0;
+          try { c = next(c); }
+          catch (...) { break; }
+        }
+        throw;
+      }
+      auto target = curr->is_reference() ? curr->ref_target.load(std::memory_order_relaxed) : curr;
+      for (auto c = this; c->ref_generation == linking; c = next(c))
+      {
+        c->ref_target.store(target, std::memory_order_relaxed);
+        c->ref_generation.store(gen, std::memory_order_release);
+      }
+    }
+    
+    // The final target of this reference, or nullptr if it is circular. The target is
+    // cached until the tree changes. Unknown references are reported, or give nullptr
+    // if `report` is false.
+    template<bool report = true>
+    Node *ref_end(const std::source_location &l) const
+    {
+      auto gen = generation.load(std::memory_order_relaxed);
+      if (ref_generation.load(std::memory_order_acquire) == gen)
+      {
+        return ref_target.load(std::memory_order_relaxed);
+      }
+      return ref_fill<report>(gen, l);
+    }
+    
+    // Resolves the reference by its path, and caches the target with `gen`.
+    template<bool report = true>
+    Node *ref_fill(std::uint64_t gen, const std::source_location &l) const
+    {
+      auto ptr = get_end_of_list_of_ref<report>(std::get<Value>(data).view<value::Reference>(), l);
+      if (ptr != nullptr)
+      {
+        // From now on, changes to this tree must invalidate the target.
+        mark_linked();
+        ref_target.store(ptr, std::memory_order_relaxed);
+        ref_generation.store(gen, std::memory_order_release);
+      }
+      return ptr;
+    }
+    
+    void mark_linked() const
+    {
+      auto r = root();
+      if (!r->linked.load(std::memory_order_relaxed)) r->mark_subtree();
+    }
+    
+    void mark_subtree() const
+    {
+      linked.store(true, std::memory_order_relaxed);
+      if (!is_node()) return;
+      for (auto &r: std::get<NodeData>(data).nodes) r->mark_subtree();
+    }
+    
+    static void invalidate_links()
+    {
+      generation.fetch_add(1, std::memory_order_relaxed);
+    }
+    
     // If there is no cycle, it returns the result of a (list of) Reference.
+    template<bool report = true>
     Node *get_end_of_list_of_ref(const value::Reference &ref,
                                  const std::source_location &l = std::source_location::current()) const
     {
-      Node *fast = get_ref(ref, l);
+      // Each reference is looked up from its own level.
+      auto next = [&l](Node *n)
+      {
+        return n->get_ref<report>(std::get<Value>(n->data).view<value::Reference>(), l);
+      };
+      Node *fast = get_ref<report>(ref, l);
       Node *slow = fast;
-      while (fast->is<value::Reference>())
+      while (fast != nullptr && fast->is_reference())
       {
-        fast = get_ref(fast->get<value::Reference>(), l);
-        if (!fast->is<value::Reference>()) break;
-        fast = get_ref(fast->get<value::Reference>(), l);
-        if (!fast->is<value::Reference>()) break;
-        slow = get_ref(slow->get<value::Reference>(), l);
+        fast = next(fast);
+        if (fast == nullptr || !fast->is_reference()) break;
+        fast = next(fast);
+        if (fast == nullptr || !fast->is_reference()) break;
+        slow = next(slow);
         if (fast == slow) return nullptr;// circular reference
       }
       return fast;
     }
   
+    // Looks up the path from the level of this Node, then from each outer level.
+    // Returns nullptr for an unknown reference if `report` is false.
+    template<bool report = true>
     Node *get_ref(const value::Reference &ref, const std::source_location &l =
     std::source_location::current()) const
     {
-      Node *nptr = last_node;
-      auto rit = ref.path.crbegin();
-      if (is_node())
+      Node *level = is_node() ? const_cast<Node *>(this) : get_last_node();
+      auto begin = ref.path.crbegin();
+      if (begin->empty())
       {
-        nptr = const_cast<Node *>(this);
-      }
-      if (rit->empty())
-      {
-        while (nptr->last_node != nullptr)
+        while (level->get_last_node() != nullptr)
         {
-          nptr = nptr->last_node;
+          level = level->get_last_node();
+        }
+        ++begin;
+        if (auto index = level->find_index(); index != nullptr && begin != ref.path.crend())
+        {
+          std::string key = *begin;
+          for (auto it = begin + 1; it != ref.path.crend(); ++it)
+          {
+            key += "::";
+            key += *it;
+          }
+          if (auto it = index->nodes.find(key); it != index->nodes.end()) return it->second;
         }
-        rit++;
       }
-  
-      for (; rit < ref.path.crend(); ++rit)
+      while (true)
       {
-        if (!nptr->has_node(*rit))
+        Node *nptr = level;
+        auto rit = begin;
+        for (; rit < ref.path.crend() && nptr->is_node(); ++rit)
         {
-          assert_true(nptr->last_node != nullptr, "Unknown reference.", czh_token, l);
-          return nptr->last_node->get_ref(ref, l);
+          auto &nd = std::get<NodeData>(nptr->data);
+          auto pos = nd.find(*rit);
+          if (pos == NodeData::npos) break;
+          nptr = nd.nodes[pos].get();
         }
-        else
+        if (rit == ref.path.crend()) return nptr;
+        if (level->get_last_node() == nullptr)
         {
-          nptr = &(*nptr)[*rit];
+          if constexpr (report) report_error("Unknown reference.", czh_token, l);
+          return nullptr;
         }
+        level = level->get_last_node();
       }
-      return nptr;
     }
   
     void assert_node(const std::source_location &l) const
@@ -705,21 +1715,116 @@ namespace czh::node
                         const std::source_location &l) const
     {
       auto &nd = std::get<NodeData>(data);
-      if (nd.get_nodes().empty())
+      if (nd.nodes.empty())
       {
         report_error("There is no node named '" + str + "' in a empty node.", czh_token, l);
         return;
       }
-      auto it = std::min_element(nd.get_nodes().cbegin(), nd.get_nodes().cend(),
+      auto it = std::min_element(nd.nodes.cbegin(), nd.nodes.cend(),
                                  [&str](auto &&n1, auto &&n2) -> bool
                                  {
-                                   return czh::utils::get_string_edit_distance(n1.name, str)
-                                          < czh::utils::get_string_edit_distance(n2.name, str);
+                                   return czh::utils::get_string_edit_distance(n1->name, str)
+                                          < czh::utils::get_string_edit_distance(n2->name, str);
                                  });
   
-      report_error("There is no node named '" + str + "'.Do you mean '" + it->name + "'?", it->czh_token, l);
+      report_error("There is no node named '" + str + "'.Do you mean '" + (*it)->name + "'?", (*it)->czh_token, l);
+    }
+  
+  };
+  
+  // Keeps the storage of recycled Nodes, so that building another tree of a similar
+  // shape does not allocate. The Nodes and their children's storage are reused.
+  class NodePool
+  {
+  private:
+    // In the order they were recycled, which is the order a parser adds them.
+    // So a tree of the same shape gets back the same Nodes with their storage.
+    Node::NodeData::NodeType spare;
+    std::size_t taken = 0;
+    Node::NodeData root;
+  public:
+    // Moves all the nodes in `node` into the pool, leaving it empty.
+    void recycle(Node &node)
+    {
+      if (!node.is_node()) return;
+      if (node.linked.load(std::memory_order_relaxed)) node.invalidate_links();
+      node.index_stale();
+      node.hash_stale();
+      spare.erase(spare.begin(), spare.begin() + static_cast<std::ptrdiff_t>(taken));
+      taken = 0;
+      collect(node);
+      auto &nd = std::get<Node::NodeData>(node.data);
+      root.clear();
+      if (nd.resource() == root.resource()) root.swap(nd);
+    }
+    
+    // Gives the storage of the last recycled root to an empty `node`.
+    void reuse(Node &node)
+    {
+      auto &nd = std::get<Node::NodeData>(node.data);
+      if (nd.nodes.empty() && nd.resource() == root.resource()) nd.swap(root);
+    }
+    
+    Node &add(Node &node, const std::string &name, Value &&val, token::Token &&token)
+    {
+      auto &ret = take(node, name, std::move(token));
+      if (ret.is_node()) ret.data.emplace<Value>(std::move(val));
+      else std::get<Value>(ret.data) = std::move(val);
+      return ret;
+    }
+    
+    Node &add_node(Node &node, const std::string &name, token::Token &&token)
+    {
+      auto &ret = take(node, name, std::move(token));
+      if (!ret.is_node()) ret.data.emplace<Node::NodeData>(node.resource());
+      return ret;
+    }
+    
+    [[nodiscard]] std::size_t size() const
+    {
+      return spare.size() - taken;
     }
   
+  private:
+    Node &take(Node &node, const std::string &name, token::Token &&token)
+    {
+      if (node.linked.load(std::memory_order_relaxed)) node.invalidate_links();
+      node.hash_stale();
+      auto &nd = std::get<Node::NodeData>(node.data);
+      std::unique_ptr<Node, Node::Deleter> ret;
+      if (taken == spare.size())
+      {
+        ret = nd.make();
+      }
+      else
+      {
+        ret = std::move(spare[taken++]);
+      }
+      ret->name = name;
+      ret->parent_anchor = node.anchor();
+      ret->index_add();
+      ret->czh_token = std::move(token);
+      ret->ref_generation.store(0, std::memory_order_relaxed);
+      ret->content_hash.store(0, std::memory_order_relaxed);
+      ret->linked.store(node.linked.load(std::memory_order_relaxed), std::memory_order_relaxed);
+      auto &r = *ret;
+      nd.insert(nd.nodes.size(), std::move(ret));
+      return r;
+    }
+    
+    void collect(Node &node)
+    {
+      auto &nd = std::get<Node::NodeData>(node.data);
+      for (auto &r: nd.nodes)
+      {
+        // The token may keep a file alive.
+        r->czh_token = token::Token();
+        auto &n = *r;
+        spare.emplace_back(std::move(r));
+        if (n.is_node()) collect(n);
+      }
+      nd.clear();
+    }
   };
   
   std::ostream &operator<<(std::ostream &os, const Node &node)
@@ -729,4 +1834,13 @@ namespace czh::node
     return os;
   }
 }
+
+template<>
+struct std::hash<czh::node::Node>
+{
+  size_t operator()(const czh::node::Node &n) const
+  {
+    return n.hash();
+  }
+};
 #endif
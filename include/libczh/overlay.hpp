@@ -0,0 +1,294 @@
+//   Copyright 2021-2023 libczh - caozhanhao
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+#ifndef LIBCZH_OVERLAY_HPP
+#define LIBCZH_OVERLAY_HPP
+#pragma once
+
+#include "node.hpp"
+#include "path.hpp"
+#include "value.hpp"
+#include "error.hpp"
+
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace czh::overlay
+{
+  // A read-only view of czh trees stacked as layers, like a base config under per-region
+  // and per-host overrides. Lookups fall through from the top layer to the bottom one, and
+  // nothing is copied, so making an Overlay costs O(layers) whatever the size of the base.
+  // A value hides everything of its name below it, and a node is merged with the nodes of
+  // its name below it, down to the first value.
+  // The layers must outlive the Overlay. A reference is resolved in its own layer.
+  class Overlay
+  {
+  private:
+    using NodeData = node::Node::NodeData;
+    // From the top to the bottom. A value is always the only layer.
+    std::vector<const node::Node *> layers;
+  public:
+    // Iterates over the merged children. A child comes at its place in the lowest layer
+    // which has it, followed by the children which only upper layers have.
+    class iterator
+    {
+    private:
+      const Overlay *overlay = nullptr;
+      // The index in `layers`, counting down to the top. npos is the end.
+      std::size_t layer = NodeData::npos;
+      std::size_t pos = 0;
+    public:
+      using iterator_category = std::input_iterator_tag;
+      using value_type = Overlay;
+      using difference_type = std::ptrdiff_t;
+      using pointer = void;
+      using reference = Overlay;
+      
+      iterator() = default;
+      
+      iterator(const Overlay *overlay_, std::size_t layer_) : overlay(overlay_), layer(layer_) { settle(); }
+      
+      reference operator*() const
+      {
+        auto &nd = children(overlay->layers[layer]);
+        auto &name = nd.nodes[pos]->name;
+        Overlay ret;
+        overlay->find(ret.layers, name, nd.hashes[pos]);
+        return ret;
+      }
+      
+      iterator &operator++()
+      {
+        ++pos;
+        settle();
+        return *this;
+      }
+      
+      iterator operator++(int)
+      {
+        auto ret = *this;
+        ++*this;
+        return ret;
+      }
+      
+      bool operator==(const iterator &i) const
+      {
+        return layer == i.layer && (layer == NodeData::npos || pos == i.pos);
+      }
+    
+    private:
+      // Skips the children which a lower layer has.
+      void settle()
+      {
+        for (; layer != NodeData::npos; --layer, pos = 0)
+        {
+          auto &nd = children(overlay->layers[layer]);
+          for (; pos < nd.nodes.size(); ++pos)
+          {
+            if (!lower_has(nd.nodes[pos]->name, nd.hashes[pos])) return;
+          }
+        }
+      }
+      
+      [[nodiscard]] bool lower_has(std::string_view name, std::size_t hash) const
+      {
+        for (auto i = layer + 1; i < overlay->layers.size(); ++i)
+        {
+          if (children(overlay->layers[i]).find(name, hash) != NodeData::npos) return true;
+        }
+        return false;
+      }
+    };
+    
+    // The layers are given from the bottom to the top, and must be nodes.
+    Overlay(std::initializer_list<std::reference_wrapper<const node::Node>> nodes,
+            const std::source_location &l = std::source_location::current())
+    {
+      error::czh_assert(nodes.size() != 0, "An Overlay needs a layer.", l);
+      for (auto &r: nodes) push(r.get(), l);
+    }
+    
+    // Adds a layer on the top.
+    Overlay &push(const node::Node &layer, const std::source_location &l =
+    std::source_location::current())
+    {
+      error::czh_assert(is_node() && layer.is_node(), "A layer must be a node.", l);
+      layers.insert(layers.begin(), &layer);
+      return *this;
+    }
+    
+    [[nodiscard]] bool is_node() const
+    {
+      return layers.empty() || layers.front()->is_node();
+    }
+    
+    [[nodiscard]] std::string get_name() const
+    {
+      return layers.front()->get_name();
+    }
+    
+    // The number of layers which are merged here.
+    [[nodiscard]] std::size_t depth() const
+    {
+      return layers.size();
+    }
+    
+    [[nodiscard]] bool has_node(std::string_view name, const std::source_location &l =
+    std::source_location::current()) const
+    {
+      assert_node(l);
+      auto h = path::hash(name);
+      for (auto r: layers)
+      {
+        if (children(r).find(name, h) != NodeData::npos) return true;
+      }
+      return false;
+    }
+    
+    Overlay operator()(std::string_view name, const std::source_location &l =
+    std::source_location::current()) const
+    {
+      assert_node(l);
+      Overlay ret;
+      find(ret.layers, name, path::hash(name));
+      if (ret.layers.empty()) report_no_node(name, l);
+      return ret;
+    }
+    
+    Overlay operator[](std::string_view name) const
+    {
+      return operator()(name);
+    }
+    
+    // Looks up a precompiled path. The layers have no common root, so it must not be global.
+    Overlay at(const path::Path &p, const std::source_location &l =
+    std::source_location::current()) const
+    {
+      error::czh_assert(!p.is_global(), "An Overlay can not look up a global path.", l);
+      Overlay ret = *this;
+      std::vector<const node::Node *> next;
+      for (auto &seg: p)
+      {
+        ret.assert_node(l);
+        ret.find(next, seg.name, seg.hash);
+        if (next.empty()) report_no_node(seg.name, l);
+        ret.layers.swap(next);
+      }
+      return ret;
+    }
+    
+    // Value only
+    [[nodiscard]] const value::Value &get_value(const std::source_location &l =
+    std::source_location::current()) const
+    {
+      return layers.front()->get_value(l);
+    }
+    
+    template<typename T>
+    T get(const std::source_location &l =
+    std::source_location::current()) const
+    {
+      return layers.front()->template get<T>(l);
+    }
+    
+    template<typename T>
+    T get(const path::Path &p, const std::source_location &l =
+    std::source_location::current()) const
+    {
+      return at(p, l).template get<T>(l);
+    }
+    
+    // Node only
+    [[nodiscard]] iterator begin(const std::source_location &l =
+    std::source_location::current()) const
+    {
+      assert_node(l);
+      return {this, layers.size() - 1};
+    }
+    
+    [[nodiscard]] iterator end(const std::source_location &l =
+    std::source_location::current()) const
+    {
+      assert_node(l);
+      return {};
+    }
+    
+    // Copies the merged tree into a Node, which does not refer to the layers.
+    // References keep their paths, and are resolved in the result.
+    [[nodiscard]] node::Node flatten(const std::source_location &l =
+    std::source_location::current()) const
+    {
+      assert_node(l);
+      node::Node ret;
+      fill(ret, *this);
+      return ret;
+    }
+  
+  private:
+    Overlay() = default;
+    
+    static const NodeData &children(const node::Node *n)
+    {
+      return std::get<NodeData>(n->data);
+    }
+    
+    // The children named `name` which are merged, from the top to the bottom.
+    void find(std::vector<const node::Node *> &ret, std::string_view name, std::size_t hash) const
+    {
+      ret.clear();
+      for (auto r: layers)
+      {
+        auto &nd = children(r);
+        auto pos = nd.find(name, hash);
+        if (pos == NodeData::npos) continue;
+        auto child = nd.nodes[pos].get();
+        if (!child->is_node())
+        {
+          if (ret.empty()) ret.emplace_back(child);
+          return;
+        }
+        ret.emplace_back(child);
+      }
+    }
+    
+    static void fill(node::Node &to, const Overlay &from)
+    {
+      for (auto &&r: from)
+      {
+        if (r.is_node())
+        {
+          fill(to.add_node(r.get_name()), r);
+        }
+        else
+        {
+          to.add(r.get_name(), value::Value(r.get_value()));
+        }
+      }
+    }
+    
+    void assert_node(const std::source_location &l) const
+    {
+      error::czh_assert(is_node(), "This Overlay is not a node.", l);
+    }
+    
+    [[noreturn]] static void report_no_node(std::string_view name, const std::source_location &l)
+    {
+      throw error::Error("There is no node named '" + std::string(name) + "'.", l);
+    }
+  };
+}
+#endif
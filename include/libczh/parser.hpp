@@ -18,11 +18,15 @@
 #include "lexer.hpp"
 #include "token.hpp"
 #include "node.hpp"
+#include "schema.hpp"
 #include "error.hpp"
 
 #include <vector>
 #include <string>
 #include <memory>
+#include <memory_resource>
+#include <optional>
+#include <future>
 
 namespace czh::parser
 {
@@ -33,19 +37,49 @@ namespace czh::parser
     node::Node node;
     node::Node *curr_node;
     token::Token curr_tok;
+    const schema::Schema *schema;
+    bool check_root;
+    std::optional<schema::Validator> validator;
+    node::NodePool *pool;
   public:
-    explicit Parser(lexer::Lexer *lex_)
-        : lex(lex_), node(node::Node()), curr_node(&node),
-          curr_tok(token::TokenType::UNEXPECTED, 0, token::Pos(nullptr)) {}
+    // The Nodes are allocated in `resource`, which must outlive them.
+    explicit Parser(lexer::Lexer *lex_, std::pmr::memory_resource *resource = std::pmr::get_default_resource())
+        : lex(lex_), node(resource), curr_node(&node),
+          curr_tok(token::TokenType::UNEXPECTED, 0, token::Pos(nullptr)), schema(nullptr), check_root(true),
+          pool(nullptr) {}
   
-    node::Node parse()
+    // Takes the Nodes from `pool_` instead of allocating them.
+    void set_pool(node::NodePool *pool_)
+    {
+      pool = pool_;
+    }
+  
+    // Checks the nodes against `schema_` while parsing. When check_root_ is false,
+    // missing nodes in the root node are not reported.
+    void set_schema(const schema::Schema *schema_, bool check_root_ = true)
+    {
+      schema = schema_;
+      check_root = check_root_;
+    }
+  
+    // References are linked to their targets at the end, unless link_refs is false.
+    node::Node parse(bool link_refs = true)
     {
       if (curr_node == nullptr)
       {
         node.reset();
-        curr_node = &node;
         lex->reset();
       }
+      if (pool != nullptr) pool->reuse(node);
+      parse_into(node, link_refs);
+      return std::move(node);
+    }
+  
+    // Parses into `root`, which must be an empty node, instead of a Node to be moved out.
+    node::Node &parse_into(node::Node &root, bool link_refs = true)
+    {
+      curr_node = &root;
+      if (schema != nullptr) validator.emplace(schema, check_root);
       curr_tok = get();
       error::czh_assert(curr_tok.type != token::TokenType::FEND, "Unexpected end of czh.");
       while (check())
@@ -62,18 +96,29 @@ namespace czh::parser
             curr_tok = get();
             break;
           case token::TokenType::FEND:
-            curr_node = nullptr;
-            return std::move(node);
+            finish(root, link_refs);
+            return root;
           default:
             error::czh_unreachable("Unexpected token");
             break;
         }
       }
-      curr_node = nullptr;
-      return std::move(node);
+      finish(root, link_refs);
+      return root;
     }
   
   private:
+    void finish(node::Node &root, bool link_refs)
+    {
+      if (validator)
+      {
+        validator->finish(curr_tok);
+        validator.reset();
+      }
+      curr_node = nullptr;
+      if (link_refs) root.link();
+    }
+    
     void parse_end()
     {
       curr_node = curr_node->get_last_node();
@@ -81,6 +126,7 @@ namespace czh::parser
       {
         curr_tok.report_error("Unexpected scope end.");
       }
+      if (validator) validator->end(curr_tok);
       if (check())
       {
         curr_tok = get();
@@ -92,37 +138,51 @@ namespace czh::parser
       if (!check()) return;
       auto id_name = curr_tok.what.get<std::string>();
       if (curr_node->has_node(id_name)) curr_tok.report_error("Duplicate node name.");
-      auto bak = token::Token(curr_tok);
+      auto bak = std::move(curr_tok);
       curr_tok = get();//eat name
       // id:
       if (curr_tok.type == token::TokenType::COLON)//scope
       {
         curr_tok = get();//eat ':'
-        curr_node = &curr_node->add_node(id_name, "", std::move(bak));
+        if (validator) validator->node(bak, id_name);
+        if (pool != nullptr) curr_node = &pool->add_node(*curr_node, id_name, std::move(bak));
+        else curr_node = &curr_node->add_node(id_name, "", std::move(bak));
         return;
       }
       //id = xxx
       curr_tok = get();//eat '='
       if (curr_tok.type == token::TokenType::ID || curr_tok.type == token::TokenType::REF)//ref id = -x:x
       {
-        curr_node->add(id_name, parse_ref(), "", std::move(bak));
+        value::Value ref(parse_ref());
+        if (validator) validator->value(bak, id_name, value::details::stored(ref));
+        add(id_name, std::move(ref), std::move(bak));
         return;
       }
       else if (curr_tok.type == token::TokenType::ARR_LP)// array id = [1,2,3]
       {
-        curr_node->add(id_name, parse_array(), "", std::move(bak));
+        auto arr = parse_array();
+        if (validator) validator->value(bak, id_name, value::details::stored(arr));
+        add(id_name, std::move(arr), std::move(bak));
         return;
       }
-      curr_node->add(id_name, curr_tok.what, "", std::move(bak));
+      if (validator) validator->value(bak, id_name, value::details::stored(curr_tok.what));
+      add(id_name, std::move(curr_tok.what), std::move(bak));
       curr_tok = get();//eat value
     }
+    
+    void add(const std::string &id_name, value::Value &&val, token::Token &&tok)
+    {
+      if (pool != nullptr) pool->add(*curr_node, id_name, std::move(val), std::move(tok));
+      else curr_node->add(id_name, std::move(val), "", std::move(tok));
+    }
   
     value::Reference parse_ref()
     {
       std::vector<std::string> path;
+      path.reserve(4);
       if (curr_tok.type == token::TokenType::REF)
       {
-        path = {""};
+        path.emplace_back();
       }
       bool id = false;
       while (curr_tok.type == token::TokenType::ID || curr_tok.type == token::TokenType::REF)
@@ -142,21 +202,22 @@ namespace czh::parser
       return {path};
     }
   
-    value::Array parse_array()
+    value::Value parse_array()
     {
-      value::Array ret;
+      value::ArrayBuilder ret;
       curr_tok = get();//eat [
       for (; curr_tok.type != token::TokenType::ARR_RP; curr_tok = get())
       {
         if (curr_tok.type == token::TokenType::COMMA) continue;
         std::visit(utils::overloaded{
-            [&ret](auto &&a) { ret.insert(ret.end(), a); },
-            [](value::Reference) { error::czh_unreachable(); },
-            [](value::Array) { error::czh_unreachable(); }
-        }, curr_tok.what.get_variant());
+            [&ret](auto &&a) { ret.add(a); },
+            [](const value::Reference &) { error::czh_unreachable(); },
+            [](const value::Array &) { error::czh_unreachable(); },
+            [](const value::details::PackedArray &) { error::czh_unreachable(); }
+        }, value::details::stored(curr_tok.what));
       }
       curr_tok = get();//eat ]
-      return ret;
+      return ret.get();
     }
     
     bool check()
@@ -169,5 +230,178 @@ namespace czh::parser
       return lex->get();
     }
   };
+  
+  // Parses a czh on several threads. The czh is split at top-level blocks,
+  // and the results are spliced into one Node in their original order.
+  // Missing nodes in the root node are checked after splicing.
+  node::Node parse_parallel(const std::string &filename, const std::shared_ptr<const std::string> &code,
+                            std::size_t threads, const schema::Schema *schema = nullptr)
+  {
+    auto chunks = lexer::split_top_level(*code, 0, code->size(), threads);
+    std::vector<std::future<node::Node>> results;
+    for (auto &[beg, end]: chunks)
+    {
+      results.emplace_back(std::async(std::launch::async, [&filename, &code, schema, beg = beg, end = end]
+      {
+        lexer::Lexer lex;
+        lex.set_czh(filename, code, beg, end);
+        Parser parser(&lex);
+        parser.set_schema(schema, false);
+        return parser.parse(false);
+      }));
+    }
+    node::Node ret;
+    for (auto &r: results)
+    {
+      ret.splice(r.get());
+    }
+    if (schema != nullptr)
+    {
+      // Reported at the end of the czh, as the serial parser does.
+      lexer::Lexer lex;
+      lex.set_czh(filename, code, code->size(), code->size());
+      auto end = lex.get();
+      for (auto &name: schema->find("")->children)
+      {
+        if (schema->find(name)->required && !ret.has_node(name)) end.report_error("Missing required node '" + name + "'.");
+      }
+    }
+    ret.link();
+    return ret;
+  }
+  
+  // Replaces [begin, end) of the code with text.
+  struct Edit
+  {
+    std::size_t begin;
+    std::size_t end;
+    std::string text;
+  };
+  
+  namespace details
+  {
+    // The block Nodes whose bodies contain the edit, from the outermost one.
+    struct EditScope
+    {
+      node::Node *node;
+      std::size_t body_beg;
+      std::size_t body_end;
+    };
+    
+    std::size_t token_begin(const token::Token &tok)
+    {
+      return tok.pos.pos - 1 - tok.pos.size;
+    }
+    
+    bool from_code(const token::Token &tok, const file::NonStreamFile *file)
+    {
+      return tok.pos.code.get() == file;
+    }
+    
+    // Only the children of the blocks on the way down are visited, and the code is scanned
+    // from the innermost block to the end of the outermost one.
+    std::vector<EditScope> find_edit_scopes(node::Node &node, const file::NonStreamFile *file, const Edit &edit)
+    {
+      auto &code = *file->code;
+      std::vector<EditScope> ret{{&node, 0, code.size()}};
+      while (true)
+      {
+        node::Node *next = nullptr;
+        for (auto &r: *ret.back().node)
+        {
+          if (!from_code(r.get_token(), file))// not parsed from the code
+          {
+            next = nullptr;
+            break;
+          }
+          r.get_token().pos.update();
+          if (token_begin(r.get_token()) >= edit.begin) break;
+          if (r.is_node()) next = &r;
+        }
+        if (next == nullptr) break;
+        auto colon = lexer::details::skip_blank(code, next->get_token().pos.pos - 1, code.size());
+        if (colon >= code.size() || code[colon] != ':' || edit.begin <= colon + 1) break;
+        ret.push_back({next, colon + 1, code.size()});
+      }
+      // Each block ends after the end of the block in it.
+      auto from = ret.back().body_beg;
+      for (auto i = ret.size() - 1; i > 0; --i)
+      {
+        auto end = lexer::find_block_end(code, from, code.size());
+        if (end == std::string::npos)
+        {
+          ret.resize(i);
+          from = ret.back().body_beg;
+          continue;
+        }
+        ret[i].body_end = end;
+        from = end + 3;
+      }
+      while (ret.size() > 1 && edit.end >= ret.back().body_end) ret.pop_back();
+      return ret;
+    }
+  }
+  
+  // Applies the edit to the code of `file`, and reparses only the innermost block whose
+  // body contains the edit. The reparsed block's Nodes are replaced and linked. The
+  // references elsewhere are resolved again on their next read, so an unknown one is
+  // reported there. `node` must be parsed from `file`, and the changes of the reparsed
+  // block which are not in the code are lost.
+  // The code is copied once, and the blocks around the edit are scanned up to the end of
+  // the outermost one. The tokens after the edit are not visited, but moved by the edit
+  // log of `file` when they are reported.
+  // Returns the reparsed Node.
+  node::Node &reparse(node::Node &node, const std::shared_ptr<file::NonStreamFile> &file, const Edit &edit)
+  {
+    auto old_code = file->code;
+    error::czh_assert(edit.begin <= edit.end && edit.end <= old_code->size(), "Invalid edit.");
+    auto code = std::make_shared<std::string>();
+    code->reserve(old_code->size() - (edit.end - edit.begin) + edit.text.size());
+    code->append(*old_code, 0, edit.begin).append(edit.text).append(*old_code, edit.end);
+    auto delta = static_cast<std::ptrdiff_t>(edit.text.size()) - static_cast<std::ptrdiff_t>(edit.end - edit.begin);
+    
+    auto scopes = details::find_edit_scopes(node, file.get(), edit);
+    // The block must still be a block on its own after the edit.
+    while (scopes.size() > 1)
+    {
+      auto &s = scopes.back();
+      auto new_end = s.body_end + delta;
+      if (lexer::find_block_end(*code, s.body_beg, new_end + 3) == new_end) break;
+      scopes.pop_back();
+    }
+    auto &scope = scopes.back();
+    auto body_end = scopes.size() > 1 ? scope.body_end + delta : code->size();
+    
+    // The new tokens are taken after the edit, so that they are not moved by it.
+    file->code = code;
+    file->edits.emplace_back(edit.end, delta);
+    node::Node body;
+    try
+    {
+      if (lexer::details::skip_blank(*code, scope.body_beg, body_end) != body_end)
+      {
+        file->codepos = scope.body_beg;
+        file->codeend = body_end;
+        lexer::Lexer lex;
+        lex.set_czh(file);
+        Parser parser(&lex);
+        body = parser.parse(false);
+      }
+    }
+    catch (...)
+    {
+      file->code = old_code;
+      file->edits.pop_back();
+      file->codepos = 0;
+      file->codeend = old_code->size();
+      throw;
+    }
+    file->codepos = 0;
+    file->codeend = code->size();
+    scope.node->clear();
+    scope.node->splice(std::move(body));
+    scope.node->link();
+    return *scope.node;
+  }
 }
 #endif
\ No newline at end of file
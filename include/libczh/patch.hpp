@@ -0,0 +1,495 @@
+//   Copyright 2021-2023 libczh - caozhanhao
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+#ifndef LIBCZH_PATCH_HPP
+#define LIBCZH_PATCH_HPP
+#pragma once
+
+#include "node.hpp"
+#include "path.hpp"
+#include "value.hpp"
+#include "writer.hpp"
+#include "error.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace czh::patch
+{
+  namespace details
+  {
+    inline void copy_children(node::Node &to, const node::Node &from)
+    {
+      to.reserve(static_cast<std::size_t>(from.cend() - from.cbegin()));
+      for (auto it = from.cbegin(); it != from.cend(); ++it)
+      {
+        if (it->is_node())
+        {
+          copy_children(to.add_node(it->get_name()), *it);
+        }
+        else
+        {
+          to.add(it->get_name(), value::Value(it->get_value()));
+        }
+      }
+    }
+    
+    // A copy of `node` named `name` which is not in any tree.
+    inline node::Node detach(const node::Node &node, const std::string &name)
+    {
+      if (!node.is_node())
+      {
+        return {nullptr, name, value::Value(node.get_value()), token::Token()};
+      }
+      node::Node ret(nullptr, name, token::Token());
+      copy_children(ret, node);
+      return ret;
+    }
+  }
+  
+  // A list of changes which turns one czh tree into another, made by diff().
+  // It is written by any Writer as czh, and read back by Czh::parse_patch(), so it can
+  // be sent to other processes.
+  class Patch
+  {
+  public:
+    struct Operation
+    {
+      enum class Kind
+      {
+        add, remove, rename, set, move
+      };
+      Kind kind;
+      // From the root, ending with the name of the Node the operation is on.
+      path::Path path;
+      // The new name of rename, or the Node that add and move put it before. Empty means the end.
+      std::string arg;
+      // The Node of add, or the value of set, whose name is the last name of path.
+      std::shared_ptr<const node::Node> payload;
+    };
+  private:
+    std::vector<Operation> ops;
+    static constexpr const char *kind_names[] = {"add", "remove", "rename", "set", "move"};
+    // Written first, so that an empty Patch is still a valid czh.
+    static constexpr int version = 1;
+  public:
+    Patch() = default;
+    
+    // Reads a Patch in the form written by accept(). References in it must not be linked.
+    explicit Patch(const node::Node &node, const std::source_location &l =
+    std::source_location::current())
+    {
+      error::czh_assert(node.has_node("version") && node["version"].get<int>(l) == version,
+                        "Unsupported patch version.", l);
+      for (auto it = node.cbegin(); it != node.cend(); ++it)
+      {
+        if (!it->is_node()) continue;
+        auto &op = *it;
+        auto kind = op["kind"].get<std::string>(l);
+        auto k = std::find(std::begin(kind_names), std::end(kind_names), kind);
+        error::czh_assert(k != std::end(kind_names), "Unknown patch operation '" + kind + "'.", l);
+        path::Path path(op["path"].get<std::string>(l), l);
+        std::string arg;
+        if (op.has_node("arg")) arg = op["arg"].get<std::string>(l);
+        std::shared_ptr<const node::Node> payload;
+        auto &name = (path.end() - 1)->name;
+        if (op.has_node("value"))
+        {
+          payload = std::make_shared<node::Node>(details::detach(op["value"], name));
+        }
+        else if (op.has_node("node"))
+        {
+          payload = std::make_shared<node::Node>(details::detach(op["node"], name));
+        }
+        ops.emplace_back(Operation{static_cast<Operation::Kind>(k - std::begin(kind_names)),
+                                   std::move(path), std::move(arg), std::move(payload)});
+      }
+    }
+    
+    void add(Operation op)
+    {
+      ops.emplace_back(std::move(op));
+    }
+    
+    [[nodiscard]] bool empty() const
+    {
+      return ops.empty();
+    }
+    
+    [[nodiscard]] std::size_t size() const
+    {
+      return ops.size();
+    }
+    
+    [[nodiscard]] auto begin() const
+    {
+      return ops.cbegin();
+    }
+    
+    [[nodiscard]] auto end() const
+    {
+      return ops.cend();
+    }
+    
+    // Writes each operation as a block, with references written as they are in the tree.
+    template<writer::Writer W>
+    const Patch &accept(W &writer) const
+    {
+      writer.value_begin("version");
+      writer.value(value::Value(version));
+      for (std::size_t i = 0; i < ops.size(); ++i)
+      {
+        auto &op = ops[i];
+        writer.node_begin("op_" + std::to_string(i));
+        writer.value_begin("kind");
+        writer.value(value::Value(kind_names[static_cast<std::size_t>(op.kind)]));
+        writer.value_begin("path");
+        writer.value(value::Value(op.path.to_string()));
+        if (!op.arg.empty())
+        {
+          writer.value_begin("arg");
+          writer.value(value::Value(op.arg));
+        }
+        if (op.payload != nullptr)
+        {
+          write(writer, *op.payload, op.payload->is_node() ? "node" : "value");
+        }
+        writer.node_end();
+      }
+      return *this;
+    }
+  
+  private:
+    template<writer::Writer W>
+    static void write(W &writer, const node::Node &node, const std::string &name)
+    {
+      if (node.is_node())
+      {
+        writer.node_begin(name);
+        for (auto it = node.cbegin(); it != node.cend(); ++it) write(writer, *it, it->get_name());
+        writer.node_end();
+        return;
+      }
+      writer.value_begin(name);
+      auto &value = node.get_value();
+      if (!value.is<value::Reference>())
+      {
+        writer::accept_value(writer, value);
+        return;
+      }
+      // The path is stored from the last name, and ends with "" if it is global.
+      auto &path = value.view<value::Reference>().path;
+      auto it = path.crbegin();
+      if (it->empty())
+      {
+        writer.value_ref_path_set_global();
+        ++it;
+      }
+      for (; it + 1 < path.crend(); ++it) writer.value_ref_path(*it);
+      writer.value_ref_id(path.front());
+    }
+  };
+  
+  inline std::ostream &operator<<(std::ostream &os, const Patch &patch)
+  {
+    writer::BasicWriter<std::ostream> w{os};
+    patch.accept(w);
+    return os;
+  }
+  
+  namespace details
+  {
+    class Differ
+    {
+    private:
+      using Op = Patch::Operation;
+      Patch patch;
+      // The path of the Node being diffed.
+      std::vector<std::string> names;
+    public:
+      Patch diff(const node::Node &from, const node::Node &to)
+      {
+        diff_node(from, to);
+        return std::move(patch);
+      }
+    
+    private:
+      // The hash of a Node without its name, to find renamed Nodes.
+      static std::size_t content_hash(const node::Node &node)
+      {
+        if (!node.is_node()) return value::details::hash_combine(1, node.get_value().hash());
+        std::size_t h = 2;
+        for (auto it = node.cbegin(); it != node.cend(); ++it) h = value::details::hash_combine(h, it->hash());
+        return h;
+      }
+      
+      void emit(Op::Kind kind, const std::string &name, std::string arg = "",
+                std::shared_ptr<const node::Node> payload = nullptr)
+      {
+        names.emplace_back(name);
+        patch.add(Op{kind, path::Path(names), std::move(arg), std::move(payload)});
+        names.pop_back();
+      }
+      
+      // Indexes of the Nodes in a longest increasing subsequence of `pos`, which stay in place.
+      static std::vector<bool> longest_increasing(const std::vector<std::size_t> &pos)
+      {
+        std::vector<std::size_t> tails;
+        std::vector<std::size_t> prev(pos.size(), pos.size());
+        for (std::size_t i = 0; i < pos.size(); ++i)
+        {
+          auto it = std::lower_bound(tails.begin(), tails.end(), i,
+                                     [&pos](std::size_t a, std::size_t b) { return pos[a] < pos[b]; });
+          if (it != tails.begin()) prev[i] = *(it - 1);
+          if (it == tails.end()) tails.emplace_back(i);
+          else *it = i;
+        }
+        std::vector<bool> kept(pos.size(), false);
+        for (auto i = tails.empty() ? pos.size() : tails.back(); i != pos.size(); i = prev[i]) kept[i] = true;
+        return kept;
+      }
+      
+      // Emits the renames so that each name is vacated before it is reused: a rename whose
+      // new name is the old name of another goes after it, and a cycle goes through a
+      // temporary name. The removes are already emitted, so no other Node holds the new names.
+      void emit_renames(const std::vector<std::size_t> &renames, const std::vector<const node::Node *> &old_nodes,
+                        const std::vector<const node::Node *> &new_nodes, const std::vector<std::size_t> &match)
+      {
+        std::vector<std::string> from(renames.size());
+        std::unordered_map<std::string, std::size_t> by_from;
+        for (std::size_t i = 0; i < renames.size(); ++i)
+        {
+          from[i] = old_nodes[renames[i]]->get_name();
+          by_from.emplace(from[i], i);
+        }
+        auto to = [&](std::size_t i) { return new_nodes[match[renames[i]]]->get_name(); };
+        // The names on this level, to pick temporary names which neither `from` nor `to` has.
+        std::unordered_set<std::string> taken;
+        std::size_t tmp_count = 0;
+        enum class State { pending, visiting, done };
+        std::vector<State> state(renames.size(), State::pending);
+        std::vector<std::size_t> chain;
+        for (std::size_t i = 0; i < renames.size(); ++i)
+        {
+          if (state[i] != State::pending) continue;
+          // Follows the renames whose old names are taken by the new name of the last one.
+          // New names are unique, so a cycle can only lead back to the first.
+          chain.assign(1, i);
+          state[i] = State::visiting;
+          while (true)
+          {
+            auto it = by_from.find(to(chain.back()));
+            if (it == by_from.end() || state[it->second] == State::done) break;
+            if (state[it->second] == State::visiting)
+            {
+              if (taken.empty())
+              {
+                for (auto n: old_nodes) taken.emplace(n->get_name());
+                for (auto n: new_nodes) taken.emplace(n->get_name());
+              }
+              auto tmp = "czh_rename_" + std::to_string(tmp_count++);
+              while (taken.contains(tmp)) tmp = "czh_rename_" + std::to_string(tmp_count++);
+              emit(Op::Kind::rename, from[i], tmp);
+              from[i] = tmp;
+              break;
+            }
+            chain.emplace_back(it->second);
+            state[it->second] = State::visiting;
+          }
+          for (auto j = chain.size(); j-- > 0;)
+          {
+            emit(Op::Kind::rename, from[chain[j]], to(chain[j]));
+            state[chain[j]] = State::done;
+          }
+        }
+      }
+      
+      void diff_node(const node::Node &from, const node::Node &to)
+      {
+        // Equal hashes of subtrees with References do not tell that their targets are equal.
+        if (auto h = from.hash(); h == to.hash() && ((h & 1) == 0 || from == to)) return;
+        std::vector<const node::Node *> old_nodes, new_nodes;
+        for (auto it = from.cbegin(); it != from.cend(); ++it) old_nodes.emplace_back(&*it);
+        for (auto it = to.cbegin(); it != to.cend(); ++it) new_nodes.emplace_back(&*it);
+        
+        // The position in new_nodes of each old Node which is kept, by name or by rename.
+        std::unordered_map<std::string, std::size_t> new_pos;
+        for (std::size_t i = 0; i < new_nodes.size(); ++i) new_pos.emplace(new_nodes[i]->get_name(), i);
+        constexpr auto npos = static_cast<std::size_t>(-1);
+        std::vector<std::size_t> match(old_nodes.size(), npos);
+        std::vector<bool> matched(new_nodes.size(), false);
+        for (std::size_t i = 0; i < old_nodes.size(); ++i)
+        {
+          auto it = new_pos.find(old_nodes[i]->get_name());
+          if (it != new_pos.end() && new_nodes[it->second]->is_node() == old_nodes[i]->is_node())
+          {
+            match[i] = it->second;
+            matched[it->second] = true;
+          }
+        }
+        std::unordered_multimap<std::size_t, std::size_t> added_by_content;
+        for (std::size_t i = 0; i < new_nodes.size(); ++i)
+        {
+          if (!matched[i] && !old_nodes.empty()) added_by_content.emplace(content_hash(*new_nodes[i]), i);
+        }
+        std::vector<bool> renamed(old_nodes.size(), false);
+        for (std::size_t i = 0; i < old_nodes.size(); ++i)
+        {
+          if (match[i] != npos || added_by_content.empty()) continue;
+          auto [b, e] = added_by_content.equal_range(content_hash(*old_nodes[i]));
+          for (auto it = b; it != e; ++it)
+          {
+            if (new_nodes[it->second]->is_node() != old_nodes[i]->is_node()) continue;
+            match[i] = it->second;
+            matched[it->second] = true;
+            renamed[i] = true;
+            added_by_content.erase(it);
+            break;
+          }
+        }
+        
+        for (std::size_t i = 0; i < old_nodes.size(); ++i)
+        {
+          if (match[i] == npos) emit(Op::Kind::remove, old_nodes[i]->get_name());
+        }
+        std::vector<std::size_t> kept_pos;
+        std::vector<std::size_t> renames;
+        for (std::size_t i = 0; i < old_nodes.size(); ++i)
+        {
+          if (match[i] == npos) continue;
+          if (renamed[i]) renames.emplace_back(i);
+          kept_pos.emplace_back(match[i]);
+        }
+        emit_renames(renames, old_nodes, new_nodes, match);
+        
+        // The Node after each new Node which is kept, or "" for the end.
+        std::vector<std::string> next_kept(new_nodes.size());
+        for (auto i = new_nodes.size(); i-- > 1;)
+        {
+          next_kept[i - 1] = matched[i] ? new_nodes[i]->get_name() : next_kept[i];
+        }
+        // Moving the Nodes out of the longest ordered run, from the last one, places
+        // each before its successor, which is already in place.
+        auto in_place = longest_increasing(kept_pos);
+        std::vector<bool> moved(new_nodes.size(), false);
+        for (std::size_t i = 0; i < kept_pos.size(); ++i) moved[kept_pos[i]] = !in_place[i];
+        for (auto i = new_nodes.size(); i-- > 0;)
+        {
+          if (moved[i]) emit(Op::Kind::move, new_nodes[i]->get_name(), next_kept[i]);
+        }
+        for (std::size_t i = 0; i < new_nodes.size(); ++i)
+        {
+          if (matched[i]) continue;
+          auto name = new_nodes[i]->get_name();
+          emit(Op::Kind::add, name, next_kept[i],
+               std::make_shared<node::Node>(details::detach(*new_nodes[i], name)));
+        }
+        
+        // Renamed Nodes are diffed too, as equal content hashes do not tell that References
+        // are equal. They are already renamed, so they are found by their new names.
+        for (std::size_t i = 0; i < old_nodes.size(); ++i)
+        {
+          if (match[i] == npos) continue;
+          auto &a = *old_nodes[i];
+          auto &b = *new_nodes[match[i]];
+          if (a.is_node())
+          {
+            names.emplace_back(b.get_name());
+            diff_node(a, b);
+            names.pop_back();
+          }
+          else if (!(a.get_value() == b.get_value()))
+          {
+            emit(Op::Kind::set, b.get_name(), "",
+                 std::make_shared<node::Node>(details::detach(b, b.get_name())));
+          }
+        }
+      }
+    };
+  }
+  
+  // The operations which turn `from` into `to`: remove, rename, move and add on each level,
+  // then set on the values which differ. Subtrees with equal hashes and no References are taken
+  // as unchanged and skipped. A Node which is removed and added with the same content is renamed.
+  inline Patch diff(const node::Node &from, const node::Node &to, const std::source_location &l =
+  std::source_location::current())
+  {
+    error::czh_assert(from.is_node() && to.is_node(), "Only nodes can be diffed.", l);
+    return details::Differ{}.diff(from, to);
+  }
+  
+  // Applies `patch` to `node`, which must be the `from` of the diff().
+  inline node::Node &apply(node::Node &node, const Patch &patch, const std::source_location &l =
+  std::source_location::current())
+  {
+    using Kind = Patch::Operation::Kind;
+    for (auto &op: patch)
+    {
+      auto parent = &node;
+      for (auto it = op.path.begin(); it + 1 != op.path.end(); ++it) parent = &(*parent)[it->name];
+      auto &name = (op.path.end() - 1)->name;
+      switch (op.kind)
+      {
+        case Kind::add:
+          error::czh_assert(op.payload != nullptr, "An add operation needs a Node.", l);
+          if (op.payload->is_node())
+          {
+            details::copy_children(parent->add_node(name, op.arg), *op.payload);
+          }
+          else
+          {
+            parent->add(name, value::Value(op.payload->get_value()), op.arg);
+          }
+          break;
+        case Kind::remove:
+          (*parent)[name].remove(l);
+          break;
+        case Kind::rename:
+          (*parent)[name].rename(op.arg, l);
+          break;
+        case Kind::move:
+          (*parent)[name].move_to(*parent, op.arg, l);
+          break;
+        case Kind::set:
+        {
+          error::czh_assert(op.payload != nullptr && !op.payload->is_node(), "A set operation needs a value.", l);
+          auto &target = (*parent)[name];
+          if (target.is<value::Reference>(l))
+          {
+            // Assigning to a reference would assign to its target, so it is replaced.
+            std::string next;
+            for (auto it = parent->cbegin(); it != parent->cend(); ++it)
+            {
+              if (&*it == &target && it + 1 != parent->cend()) next = (it + 1)->get_name();
+            }
+            target.remove(l);
+            parent->add(name, value::Value(op.payload->get_value()), next);
+          }
+          else
+          {
+            target = value::Value(op.payload->get_value());
+          }
+          break;
+        }
+      }
+    }
+    return node;
+  }
+}
+#endif
@@ -0,0 +1,119 @@
+//   Copyright 2021-2023 libczh - caozhanhao
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+#ifndef LIBCZH_PATH_HPP
+#define LIBCZH_PATH_HPP
+#pragma once
+
+#include "error.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace czh::path
+{
+  // The hash of a node name, shared by Path and the index of the children of a Node.
+  inline std::size_t hash(std::string_view name)
+  {
+    return std::hash<std::string_view>{}(name);
+  }
+  
+  // A path like "a::b::c", split and hashed once, so that looking it up again
+  // only compares names. A path beginning with "::" is looked up from the root.
+  class Path
+  {
+  public:
+    struct Segment
+    {
+      std::string name;
+      std::size_t hash;
+    };
+  private:
+    std::vector<Segment> segments;
+    // Without the leading "::".
+    std::string str;
+    bool global = false;
+  public:
+    explicit Path(std::string_view str, const std::source_location &l =
+    std::source_location::current())
+    {
+      if (str.starts_with("::"))
+      {
+        global = true;
+        str.remove_prefix(2);
+      }
+      for (std::size_t beg = 0, end; beg <= str.size(); beg = end + 2)
+      {
+        end = (std::min)(str.find("::", beg), str.size());
+        add(str.substr(beg, end - beg), l);
+      }
+    }
+    
+    Path(std::initializer_list<std::string_view> names, const std::source_location &l =
+    std::source_location::current())
+    {
+      for (auto &r: names) add(r, l);
+    }
+    
+    explicit Path(const std::vector<std::string> &names, const std::source_location &l =
+    std::source_location::current())
+    {
+      for (auto &r: names) add(r, l);
+    }
+    
+    [[nodiscard]] bool is_global() const
+    {
+      return global;
+    }
+    
+    [[nodiscard]] std::size_t size() const
+    {
+      return segments.size();
+    }
+    
+    [[nodiscard]] auto begin() const
+    {
+      return segments.cbegin();
+    }
+    
+    [[nodiscard]] auto end() const
+    {
+      return segments.cend();
+    }
+    
+    [[nodiscard]] std::string to_string() const
+    {
+      return global ? "::" + str : str;
+    }
+    
+    // The path from the root without the leading "::", as it is stored in a path index.
+    [[nodiscard]] const std::string &key() const
+    {
+      return str;
+    }
+  
+  private:
+    void add(std::string_view name, const std::source_location &l)
+    {
+      error::czh_assert(!name.empty(), "Invalid path.", l);
+      if (!segments.empty()) str += "::";
+      str += name;
+      segments.emplace_back(Segment{std::string(name), hash(name)});
+    }
+  };
+}
+#endif
@@ -0,0 +1,298 @@
+//   Copyright 2021-2023 libczh - caozhanhao
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+#ifndef LIBCZH_SCHEMA_HPP
+#define LIBCZH_SCHEMA_HPP
+#pragma once
+
+#include "token.hpp"
+#include "value.hpp"
+#include "error.hpp"
+
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace czh::schema
+{
+  // The rule of one node. Rules are stored by their full path, like "a::b::c".
+  struct Rule
+  {
+    static constexpr int any = -1;
+    bool is_node = false;
+    int type = any;// index in VTList
+    int elem_type = any;// index in BasicVTList, for arrays
+    std::optional<double> min;
+    std::optional<double> max;
+    bool required = true;
+    bool closed = false;// only declared nodes are allowed in this node
+    std::size_t index = 0;// index in the parent's children
+    std::vector<std::string> children;
+  };
+  
+  // Describes the expected nodes of a czh. It is built once and then looked up
+  // by path while parsing. The root node's path is "".
+  class Schema
+  {
+  private:
+    std::unordered_map<std::string, Rule> rules;
+    std::string last;
+  public:
+    Schema() { rules[""].is_node = true; }
+    
+    template<typename T>
+    Schema &value(const std::string &path)
+    {
+      auto &rule = declare(path);
+      rule.is_node = false;
+      if constexpr (value::details::is_czh_container_v<T>)
+      {
+        using E = std::remove_cvref_t<decltype(*std::begin(std::declval<T &>()))>;
+        static_assert(value::details::index_of_v<E, value::details::BasicVTList> != -1, "Unexpected type.");
+        rule.type = value::details::index_of_v<value::Array, value::details::VTList>;
+        rule.elem_type = value::details::index_of_v<E, value::details::BasicVTList>;
+      }
+      else if constexpr (!std::is_same_v<T, value::Value>)
+      {
+        static_assert(value::details::index_of_v<T, value::details::VTList> != -1, "Unexpected type.");
+        rule.type = value::details::index_of_v<T, value::details::VTList>;
+      }
+      return *this;
+    }
+    
+    Schema &node(const std::string &path)
+    {
+      declare(path).is_node = true;
+      return *this;
+    }
+    
+    // The following functions modify the last declared node.
+    Schema &optional()
+    {
+      rules[last].required = false;
+      return *this;
+    }
+    
+    // Applies to numbers and the elements of number arrays.
+    Schema &range(double min, double max)
+    {
+      auto &rule = rules[last];
+      rule.min = min;
+      rule.max = max;
+      return *this;
+    }
+    
+    // Disallows nodes which are not declared. Use closed_root() for the root node.
+    Schema &closed()
+    {
+      rules[last].closed = true;
+      return *this;
+    }
+    
+    Schema &closed_root()
+    {
+      rules[""].closed = true;
+      return *this;
+    }
+    
+    const Rule *find(const std::string &path) const
+    {
+      auto it = rules.find(path);
+      if (it == rules.end()) return nullptr;
+      return &it->second;
+    }
+  
+  private:
+    // Declares the node and its parents, which are declared as nodes.
+    Rule &declare(const std::string &path)
+    {
+      std::string parent;
+      std::size_t beg = 0;
+      while (true)
+      {
+        auto end = path.find("::", beg);
+        auto curr = path.substr(0, end);
+        auto name = path.substr(beg, end == std::string::npos ? std::string::npos : end - beg);
+        error::czh_assert(!name.empty(), "Invalid schema path.");
+        if (rules.find(curr) == rules.end())
+        {
+          auto &p = rules[parent];
+          Rule rule;
+          rule.is_node = true;
+          rule.index = p.children.size();
+          p.children.emplace_back(name);
+          rules.emplace(curr, std::move(rule));
+        }
+        if (end == std::string::npos) break;
+        parent = std::move(curr);
+        beg = end + 2;
+      }
+      last = path;
+      return rules[path];
+    }
+  };
+  
+  // Checks the nodes against a Schema while they are being parsed.
+  class Validator
+  {
+  private:
+    struct Frame
+    {
+      const Rule *rule;
+      std::size_t path_size;
+      std::vector<bool> seen;
+    };
+    const Schema *schema;
+    std::string path;
+    std::vector<Frame> frames;
+    bool check_root;
+  public:
+    // When check_root is false, missing nodes in the root node are not reported.
+    explicit Validator(const Schema *schema_, bool check_root_ = true)
+        : schema(schema_), check_root(check_root_)
+    {
+      enter(schema->find(""));
+    }
+    
+    void node(const token::Token &tok, const std::string &id)
+    {
+      auto rule = lookup(tok, id);
+      if (rule != nullptr && !rule->is_node) tok.report_error("Expected a value, but got a node.");
+      enter(rule);
+    }
+    
+    void value(const token::Token &tok, const std::string &id, const value::details::StoredVT &val)
+    {
+      auto rule = lookup(tok, id);
+      path.resize(frames.back().path_size);
+      if (rule == nullptr) return;
+      if (rule->is_node) tok.report_error("Expected a node, but got a value.");
+      if (rule->type == Rule::any || std::holds_alternative<value::Reference>(val)) return;
+      auto type = val.index() == value::details::packed_array_index
+                  ? value::details::index_of_v<value::Array, value::details::VTList> : val.index();
+      if (static_cast<int>(type) != rule->type)
+      {
+        tok.report_error("Unexpected type.[Expected T = '" + value::details::get_typename(rule->type)
+                         + "', Actual T = '" + value::details::get_typename(type) + "']");
+      }
+      if (auto arr = std::get_if<value::Array>(&val))
+      {
+        for (auto &e: *arr)
+        {
+          check_element_type(tok, *rule, e.index());
+          check_range(tok, *rule, e);
+        }
+      }
+      else if (auto packed = std::get_if<value::details::PackedArray>(&val))
+      {
+        std::visit([this, &tok, rule](auto &&arr)
+        {
+          using E = typename std::decay_t<decltype(arr)>::value_type;
+          if (arr.empty()) return;
+          check_element_type(tok, *rule, value::details::index_of_v<E, value::details::BasicVTList>);
+          if constexpr (std::is_arithmetic_v<E> && !std::is_same_v<E, bool>)
+          {
+            for (auto e: arr) check_range(tok, *rule, e);
+          }
+        }, *packed);
+      }
+      else
+      {
+        std::visit([this, &tok, rule](auto &&v) { check_range(tok, *rule, v); }, val);
+      }
+    }
+    
+    // Checks the required nodes at the scope end.
+    void end(const token::Token &tok)
+    {
+      if (frames.size() <= 1) return;// reported by the parser
+      leave(tok);
+    }
+    
+    // Checks all the unclosed nodes at the end of file.
+    void finish(const token::Token &tok)
+    {
+      while (frames.size() > 1) leave(tok);
+      if (check_root) leave(tok);
+    }
+  
+  private:
+    const Rule *lookup(const token::Token &tok, const std::string &id)
+    {
+      auto &frame = frames.back();
+      path.resize(frame.path_size);
+      if (frame.rule == nullptr) return nullptr;
+      if (!path.empty()) path += "::";
+      path += id;
+      auto rule = schema->find(path);
+      if (rule == nullptr)
+      {
+        if (frame.rule->closed) tok.report_error("Unknown node '" + path + "'.");
+        return nullptr;
+      }
+      frame.seen[rule->index] = true;
+      return rule;
+    }
+    
+    void enter(const Rule *rule)
+    {
+      std::vector<bool> seen;
+      if (rule != nullptr) seen.resize(rule->children.size());
+      frames.emplace_back(Frame{rule, path.size(), std::move(seen)});
+    }
+    
+    void leave(const token::Token &tok)
+    {
+      auto &frame = frames.back();
+      path.resize(frame.path_size);
+      if (frame.rule != nullptr)
+      {
+        for (std::size_t i = 0; i < frame.seen.size(); ++i)
+        {
+          if (frame.seen[i]) continue;
+          auto child = path.empty() ? frame.rule->children[i] : path + "::" + frame.rule->children[i];
+          if (schema->find(child)->required) tok.report_error("Missing required node '" + child + "'.");
+        }
+      }
+      frames.pop_back();
+      if (!frames.empty()) path.resize(frames.back().path_size);
+    }
+    
+    void check_element_type(const token::Token &tok, const Rule &rule, std::size_t type)
+    {
+      if (rule.elem_type != Rule::any && static_cast<int>(type) != rule.elem_type)
+      {
+        tok.report_error("Unexpected element type.[Expected T = '" + value::details::get_typename(rule.elem_type)
+                         + "', Actual T = '" + value::details::get_typename(type) + "']");
+      }
+    }
+    
+    template<typename T>
+    void check_range(const token::Token &tok, const Rule &rule, const T &v)
+    {
+      if constexpr (std::is_arithmetic_v<T> && !std::is_same_v<T, bool>)
+      {
+        if ((rule.min && v < *rule.min) || (rule.max && v > *rule.max))
+        {
+          tok.report_error("Value out of range.");
+        }
+      }
+      else if constexpr (std::is_same_v<T, value::details::BasicVT>)
+      {
+        std::visit([this, &tok, &rule](auto &&e) { check_range(tok, rule, e); }, v);
+      }
+    }
+  };
+}
+#endif
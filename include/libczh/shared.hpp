@@ -0,0 +1,205 @@
+//   Copyright 2021-2023 libczh - caozhanhao
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+#ifndef LIBCZH_SHARED_HPP
+#define LIBCZH_SHARED_HPP
+#pragma once
+
+#include "snapshot.hpp"
+#include "error.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace czh::shared
+{
+  // Publishes versions of a config to concurrent readers. Readers never take a lock:
+  // each Reader owns a hazard slot, and a version is deleted only when no slot holds it.
+  // Writers are serialized, copy the current Snapshot in O(1), change it and publish it.
+  class SharedConfig
+  {
+  private:
+    // Aligned so that readers on different cores do not share a cache line.
+    struct alignas(64) Slot
+    {
+      std::atomic<const snapshot::Snapshot *> hazard{nullptr};
+      std::atomic<bool> used{false};
+      Slot *next = nullptr;
+    };
+    std::atomic<const snapshot::Snapshot *> current;
+    // Slots are never freed before the SharedConfig, so readers can always walk the list.
+    std::atomic<Slot *> slots{nullptr};
+    std::mutex write_mutex;
+    std::vector<const snapshot::Snapshot *> retired;
+  public:
+    class Reader;
+    
+    class Guard
+    {
+      friend class Reader;
+    private:
+      Slot *slot;
+      const snapshot::Snapshot *ptr;
+      
+      Guard(Slot *slot_, const snapshot::Snapshot *ptr_) : slot(slot_), ptr(ptr_) {}
+    
+    public:
+      Guard(Guard &&g) noexcept: slot(g.slot), ptr(g.ptr) { g.slot = nullptr; }
+      
+      Guard(const Guard &) = delete;
+      
+      Guard &operator=(const Guard &) = delete;
+      
+      ~Guard()
+      {
+        if (slot != nullptr) slot->hazard.store(nullptr, std::memory_order_release);
+      }
+      
+      const snapshot::Snapshot &operator*() const
+      {
+        return *ptr;
+      }
+      
+      const snapshot::Snapshot *operator->() const
+      {
+        return ptr;
+      }
+    };
+    
+    // Reads versions on one thread. Keep it for as long as the thread reads.
+    class Reader
+    {
+      friend class SharedConfig;
+    private:
+      SharedConfig *config;
+      Slot *slot;
+      
+      explicit Reader(SharedConfig *config_) : config(config_), slot(config->acquire_slot()) {}
+    
+    public:
+      Reader(Reader &&r) noexcept: config(r.config), slot(r.slot) { r.slot = nullptr; }
+      
+      Reader(const Reader &) = delete;
+      
+      Reader &operator=(const Reader &) = delete;
+      
+      ~Reader()
+      {
+        if (slot != nullptr) slot->used.store(false, std::memory_order_release);
+      }
+      
+      // The version stays valid until the Guard is destroyed. A Reader holds one Guard at a time.
+      [[nodiscard]] Guard read(const std::source_location &l =
+      std::source_location::current()) const
+      {
+        error::czh_assert(slot->hazard.load(std::memory_order_relaxed) == nullptr,
+                          "This Reader already holds a Guard.", l);
+        auto ptr = config->current.load(std::memory_order_seq_cst);
+        while (true)
+        {
+          slot->hazard.store(ptr, std::memory_order_seq_cst);
+          auto now = config->current.load(std::memory_order_seq_cst);
+          if (now == ptr) break;
+          ptr = now;
+        }
+        return Guard(slot, ptr);
+      }
+    };
+    
+    explicit SharedConfig(snapshot::Snapshot initial = {})
+        : current(new snapshot::Snapshot(std::move(initial))) {}
+    
+    SharedConfig(const SharedConfig &) = delete;
+    
+    SharedConfig &operator=(const SharedConfig &) = delete;
+    
+    // All the Readers must be destroyed before.
+    ~SharedConfig()
+    {
+      delete current.load();
+      for (auto r: retired) delete r;
+      for (auto s = slots.load(); s != nullptr;)
+      {
+        auto next = s->next;
+        delete s;
+        s = next;
+      }
+    }
+    
+    [[nodiscard]] Reader reader()
+    {
+      return Reader(this);
+    }
+    
+    // Publishes `next` as the current version.
+    void publish(snapshot::Snapshot next)
+    {
+      std::lock_guard lock(write_mutex);
+      publish_locked(std::move(next));
+    }
+    
+    // Calls f with a copy of the current version, and publishes it.
+    template<typename F>
+    void update(F &&f)
+    {
+      std::lock_guard lock(write_mutex);
+      auto next = *current.load(std::memory_order_relaxed);
+      std::forward<F>(f)(next);
+      publish_locked(std::move(next));
+    }
+  
+  private:
+    void publish_locked(snapshot::Snapshot next)
+    {
+      auto old = current.exchange(new snapshot::Snapshot(std::move(next)), std::memory_order_seq_cst);
+      retired.emplace_back(old);
+      reclaim();
+    }
+    
+    // Deletes the retired versions which no Reader holds.
+    void reclaim()
+    {
+      std::vector<const snapshot::Snapshot *> hazards;
+      for (auto s = slots.load(std::memory_order_acquire); s != nullptr; s = s->next)
+      {
+        if (auto h = s->hazard.load(std::memory_order_seq_cst); h != nullptr) hazards.emplace_back(h);
+      }
+      std::sort(hazards.begin(), hazards.end());
+      auto kept = std::partition(retired.begin(), retired.end(), [&hazards](auto &&r)
+      {
+        return std::binary_search(hazards.begin(), hazards.end(), r);
+      });
+      for (auto it = kept; it != retired.end(); ++it) delete *it;
+      retired.erase(kept, retired.end());
+    }
+    
+    // Reuses a slot of a destroyed Reader, or adds one.
+    Slot *acquire_slot()
+    {
+      for (auto s = slots.load(std::memory_order_acquire); s != nullptr; s = s->next)
+      {
+        bool expected = false;
+        if (s->used.compare_exchange_strong(expected, true, std::memory_order_acquire)) return s;
+      }
+      auto s = new Slot;
+      s->used.store(true, std::memory_order_relaxed);
+      s->next = slots.load(std::memory_order_relaxed);
+      while (!slots.compare_exchange_weak(s->next, s, std::memory_order_release, std::memory_order_relaxed));
+      return s;
+    }
+  };
+}
+#endif
@@ -0,0 +1,301 @@
+//   Copyright 2021-2023 libczh - caozhanhao
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+#ifndef LIBCZH_SNAPSHOT_HPP
+#define LIBCZH_SNAPSHOT_HPP
+#pragma once
+
+#include "node.hpp"
+#include "value.hpp"
+#include "error.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <string>
+#include <variant>
+#include <vector>
+
+namespace czh::snapshot
+{
+  // A czh tree whose subtrees are shared between copies by reference count.
+  // Copying a Snapshot is O(1). A change clones only the nodes on the path to the
+  // changed node which are still shared, so the copies are never affected.
+  // Paths are given from the root, like {"a", "b", "c"} for a::b::c.
+  class Snapshot
+  {
+  private:
+    struct Entry;
+    using EntryPtr = std::shared_ptr<Entry>;
+    struct Entry
+    {
+      std::string name;
+      std::variant<std::vector<EntryPtr>, value::Value> data;
+      
+      [[nodiscard]] bool is_node() const
+      {
+        return data.index() == 0;
+      }
+      
+      // Looks up a child by name. Wide nodes are not indexed, as a change copies
+      // the child list anyway.
+      [[nodiscard]] EntryPtr *find(const std::string &s)
+      {
+        auto &children = std::get<0>(data);
+        auto it = std::find_if(children.begin(), children.end(), [&s](auto &&e) { return e->name == s; });
+        return it == children.end() ? nullptr : &*it;
+      }
+    };
+    EntryPtr root;
+  public:
+    Snapshot() : root(std::make_shared<Entry>()) {}
+    
+    explicit Snapshot(const node::Node &node, const std::source_location &l =
+    std::source_location::current())
+    {
+      error::czh_assert(node.is_node(), "A Snapshot must be made from a node.", l);
+      root = make(node);
+    }
+    
+    [[nodiscard]] bool contains(const std::vector<std::string> &path) const
+    {
+      auto e = root.get();
+      for (auto &name: path)
+      {
+        if (!e->is_node()) return false;
+        auto next = e->find(name);
+        if (next == nullptr) return false;
+        e = next->get();
+      }
+      return true;
+    }
+    
+    [[nodiscard]] bool is_node(const std::vector<std::string> &path, const std::source_location &l =
+    std::source_location::current()) const
+    {
+      std::vector<Entry *> scope;
+      return lookup(path, scope, l)->is_node();
+    }
+    
+    // The names of the children of the node at `path`.
+    [[nodiscard]] std::vector<std::string> names(const std::vector<std::string> &path = {},
+                                                 const std::source_location &l =
+                                                 std::source_location::current()) const
+    {
+      std::vector<Entry *> scope;
+      auto e = lookup(path, scope, l);
+      error::czh_assert(e->is_node(), "This Node is not a node.", l);
+      std::vector<std::string> ret;
+      for (auto &r: std::get<0>(e->data)) ret.emplace_back(r->name);
+      return ret;
+    }
+    
+    // Returns the value itself without resolving references.
+    [[nodiscard]] value::Value get_value(const std::vector<std::string> &path, const std::source_location &l =
+    std::source_location::current()) const
+    {
+      std::vector<Entry *> scope;
+      auto e = lookup(path, scope, l);
+      error::czh_assert(!e->is_node(), "This Node is not a value.", l);
+      return value::Value(std::get<1>(e->data));
+    }
+    
+    // References are resolved in the same way as Node::get().
+    template<typename T>
+    [[nodiscard]] T get(const std::vector<std::string> &path, const std::source_location &l =
+    std::source_location::current()) const
+    {
+      std::vector<Entry *> scope;
+      auto e = lookup(path, scope, l);
+      if constexpr (!std::is_same_v<T, value::Reference>)
+      {
+        e = resolve(e, scope, l);
+      }
+      error::czh_assert(!e->is_node(), "This Node is not a value.", l);
+      auto &value = std::get<1>(e->data);
+      error::czh_assert(value.can_get<T>(), "The value is not '" + std::string(value::details::nameof<T>())
+                                            + "'.[Actual T = '" + value.get_typename() + "'].", l);
+      return value.template get<T>();
+    }
+    
+    // Sets the value at `path`, adding it to its parent if it does not exist.
+    // A node or a reference at `path` is replaced.
+    template<typename T>
+    Snapshot &set(const std::vector<std::string> &path, T &&v, const std::source_location &l =
+    std::source_location::current())
+    {
+      auto &parent = own_parent(path, l);
+      auto slot = parent.find(path.back());
+      if (slot == nullptr)
+      {
+        std::get<0>(parent.data).emplace_back(std::make_shared<Entry>(
+            Entry{path.back(), value::Value(std::forward<T>(v))}));
+      }
+      else
+      {
+        own(*slot).data = value::Value(std::forward<T>(v));
+      }
+      return *this;
+    }
+    
+    Snapshot &add_node(const std::vector<std::string> &path, const std::source_location &l =
+    std::source_location::current())
+    {
+      auto &parent = own_parent(path, l);
+      error::czh_assert(parent.find(path.back()) == nullptr, "Duplicate node name.", l);
+      std::get<0>(parent.data).emplace_back(std::make_shared<Entry>(Entry{path.back(), {}}));
+      return *this;
+    }
+    
+    Snapshot &remove(const std::vector<std::string> &path, const std::source_location &l =
+    std::source_location::current())
+    {
+      auto &parent = own_parent(path, l);
+      auto slot = parent.find(path.back());
+      if (slot == nullptr) report_no_node(path.back(), l);
+      auto &children = std::get<0>(parent.data);
+      children.erase(children.begin() + (slot - children.data()));
+      return *this;
+    }
+    
+    // Copies the tree into a Node, which is not shared with this Snapshot.
+    [[nodiscard]] node::Node to_node() const
+    {
+      node::Node ret;
+      fill(ret, *root);
+      return ret;
+    }
+  
+  private:
+    static EntryPtr make(const node::Node &node)
+    {
+      if (!node.is_node())
+      {
+        return std::make_shared<Entry>(Entry{node.get_name(), value::Value(node.get_value())});
+      }
+      std::vector<EntryPtr> children;
+      children.reserve(node.cend() - node.cbegin());
+      for (auto it = node.cbegin(); it != node.cend(); ++it) children.emplace_back(make(*it));
+      return std::make_shared<Entry>(Entry{node.get_name(), std::move(children)});
+    }
+    
+    static void fill(node::Node &node, const Entry &entry)
+    {
+      node.reserve(std::get<0>(entry.data).size());
+      for (auto &r: std::get<0>(entry.data))
+      {
+        if (r->is_node())
+        {
+          fill(node.add_node(r->name), *r);
+        }
+        else
+        {
+          node.add(r->name, value::Value(std::get<1>(r->data)));
+        }
+      }
+    }
+    
+    // Clones the entry if it is shared.
+    static Entry &own(EntryPtr &ptr)
+    {
+      if (ptr.use_count() != 1)
+      {
+        ptr = std::make_shared<Entry>(*ptr);
+      }
+      else
+      {
+        // The last other owner may have just released it.
+        std::atomic_thread_fence(std::memory_order_acquire);
+      }
+      return *ptr;
+    }
+    
+    // Owns the path to the parent of `path`, and returns the parent.
+    Entry &own_parent(const std::vector<std::string> &path, const std::source_location &l)
+    {
+      error::czh_assert(!path.empty(), "The path must not be empty.", l);
+      auto e = &own(root);
+      for (auto it = path.cbegin(); it + 1 < path.cend(); ++it)
+      {
+        auto next = e->find(*it);
+        if (next == nullptr) report_no_node(*it, l);
+        e = &own(*next);
+        error::czh_assert(e->is_node(), "This Node is not a node.", l);
+      }
+      return *e;
+    }
+    
+    // `scope` becomes the nodes from the root to the parent of the result.
+    Entry *lookup(const std::vector<std::string> &path, std::vector<Entry *> &scope,
+                  const std::source_location &l) const
+    {
+      auto e = root.get();
+      for (auto &name: path)
+      {
+        error::czh_assert(e->is_node(), "This Node is not a node.", l);
+        auto next = e->find(name);
+        if (next == nullptr) report_no_node(name, l);
+        scope.emplace_back(e);
+        e = next->get();
+      }
+      return e;
+    }
+    
+    // Follows references until a non-reference, looking up each path from the level
+    // of the reference, then from each outer level, like Node::get_ref().
+    static Entry *resolve(Entry *e, std::vector<Entry *> &scope, const std::source_location &l)
+    {
+      std::vector<Entry *> visited;
+      while (!e->is_node() && std::get<1>(e->data).is<value::Reference>())
+      {
+        error::czh_assert(std::find(visited.begin(), visited.end(), e) == visited.end(),
+                          "Can not get a circular reference.", l);
+        visited.emplace_back(e);
+        auto &path = std::get<1>(e->data).view<value::Reference>().path;
+        auto begin = path.crbegin();
+        if (begin->empty())
+        {
+          scope.resize(1);
+          ++begin;
+        }
+        while (true)
+        {
+          auto depth = scope.size();
+          auto target = scope.back();
+          auto rit = begin;
+          for (; rit < path.crend() && target->is_node(); ++rit)
+          {
+            auto next = target->find(*rit);
+            if (next == nullptr) break;
+            scope.emplace_back(target);
+            target = next->get();
+          }
+          if (rit == path.crend())
+          {
+            e = target;
+            break;
+          }
+          scope.resize(depth - 1);
+          error::czh_assert(!scope.empty(), "Unknown reference.", l);
+        }
+      }
+      return e;
+    }
+    
+    [[noreturn]] static void report_no_node(const std::string &name, const std::source_location &l)
+    {
+      throw error::Error("There is no node named '" + name + "'.", l);
+    }
+  };
+}
+#endif
@@ -0,0 +1,788 @@
+//   Copyright 2021-2023 libczh - caozhanhao
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+#ifndef LIBCZH_TAPE_HPP
+#define LIBCZH_TAPE_HPP
+#pragma once
+
+#include "lexer.hpp"
+#include "node.hpp"
+#include "token.hpp"
+#include "value.hpp"
+#include "error.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+
+// A read-only czh stored in one contiguous tape of 64-bit entries and one string arena.
+// Each entry is a type in the high 8 bits and a payload in the low 56 bits.
+//
+//   root/block: [ROOT|end] ... [ROOT|index]  [BLOCK_BEG|after end] ... [BLOCK_END|index]
+//   element:    [KEY|name] value
+//   value:      [NUL] [INT|int] [LONG_LONG][raw] [DOUBLE][raw] [TRUE] [FALSE] [STRING|str]
+//               [ARRAY_BEG|after end] values... [ARRAY_END]
+//               [REFERENCE|target][raw path str]
+// Strings are stored in the arena as a 32-bit size followed by the characters.
+// References are resolved when the tape is built, and point to the final non-reference value.
+// Blocks with more than 8 elements have an index of their keys sorted by hash, and the end of
+// the block holds its offset + 1 in the index, or 0 for none.
+// A Tape is never changed after it is built, so it can be read from any number of threads.
+namespace czh::tape
+{
+  enum class Type : std::uint8_t
+  {
+    ROOT, BLOCK_BEG, BLOCK_END, KEY,
+    NUL, INT, LONG_LONG, DOUBLE, TRUE, FALSE, STRING,
+    ARRAY_BEG, ARRAY_END, REFERENCE
+  };
+  
+  class ElementView;
+  
+  class Tape
+  {
+    friend class TapeParser;
+    friend class Freezer;
+    friend class ElementView;
+  private:
+    static constexpr std::uint64_t payload_mask = (std::uint64_t(1) << 56) - 1;
+    static constexpr std::size_t small_size = 8;
+    struct PendingRef
+    {
+      std::size_t pos;
+      std::vector<std::size_t> blocks;
+      std::vector<std::string> path;
+      bool global;
+      token::Token token;
+    };
+    std::vector<std::uint64_t> tape;
+    std::string strings;
+    // [count] followed by count pairs of [hash][position of the value], sorted by hash.
+    std::vector<std::uint64_t> index;
+  public:
+    [[nodiscard]] ElementView root() const;
+    
+    // Memory used by the tape, the string arena and the index.
+    [[nodiscard]] std::size_t size_in_bytes() const
+    {
+      return (tape.size() + index.size()) * sizeof(std::uint64_t) + strings.size();
+    }
+  
+  private:
+    static std::uint64_t entry(Type type, std::uint64_t payload = 0)
+    {
+      return (static_cast<std::uint64_t>(type) << 56) | (payload & payload_mask);
+    }
+    
+    [[nodiscard]] Type type_at(std::size_t pos) const
+    {
+      return static_cast<Type>(tape[pos] >> 56);
+    }
+    
+    [[nodiscard]] std::uint64_t payload_at(std::size_t pos) const
+    {
+      return tape[pos] & payload_mask;
+    }
+    
+    [[nodiscard]] std::string_view string_at(std::size_t offset) const
+    {
+      std::uint32_t sz;
+      std::memcpy(&sz, strings.data() + offset, sizeof(sz));
+      return {strings.data() + offset + sizeof(sz), sz};
+    }
+    
+    std::size_t add_string(std::string_view str)
+    {
+      auto offset = strings.size();
+      auto sz = static_cast<std::uint32_t>(str.size());
+      strings.append(reinterpret_cast<const char *>(&sz), sizeof(sz));
+      strings.append(str);
+      return offset;
+    }
+    
+    // The position after the value at `pos`.
+    [[nodiscard]] std::size_t next(std::size_t pos) const
+    {
+      switch (type_at(pos))
+      {
+        case Type::BLOCK_BEG:
+        case Type::ARRAY_BEG:
+          return payload_at(pos);
+        case Type::LONG_LONG:
+        case Type::DOUBLE:
+        case Type::REFERENCE:
+          return pos + 2;
+        default:
+          return pos + 1;
+      }
+    }
+    
+    // The position of the last entry of the block at `pos`.
+    [[nodiscard]] std::size_t block_end(std::size_t pos) const
+    {
+      return payload_at(pos) - 1;
+    }
+    
+    static std::uint64_t hash(std::string_view name)
+    {
+      return std::hash<std::string_view>{}(name);
+    }
+    
+    [[nodiscard]] std::size_t find(std::size_t block, std::string_view name) const
+    {
+      auto idx = payload_at(block_end(block));
+      if (idx == 0)
+      {
+        for (auto pos = block + 1; pos < block_end(block); pos = next(pos + 1))
+        {
+          if (string_at(payload_at(pos)) == name) return pos + 1;
+        }
+        return 0;
+      }
+      auto h = hash(name);
+      std::size_t lo = 0;
+      std::size_t hi = index[idx - 1];
+      while (lo < hi)
+      {
+        auto mid = lo + (hi - lo) / 2;
+        if (index[idx + mid * 2] < h) lo = mid + 1;
+        else hi = mid;
+      }
+      for (; lo < index[idx - 1] && index[idx + lo * 2] == h; ++lo)
+      {
+        auto pos = index[idx + lo * 2 + 1];
+        if (string_at(payload_at(pos - 1)) == name) return pos;
+      }
+      return 0;
+    }
+    
+    // Indexes the wide blocks in the block at `block`, and itself.
+    void build_index(std::size_t block)
+    {
+      std::vector<std::pair<std::uint64_t, std::uint64_t>> keys;
+      for (auto pos = block + 1; pos < block_end(block); pos = next(pos + 1))
+      {
+        keys.emplace_back(hash(string_at(payload_at(pos))), pos + 1);
+        if (is_block(pos + 1)) build_index(pos + 1);
+      }
+      if (keys.size() <= small_size) return;
+      std::sort(keys.begin(), keys.end());
+      index.emplace_back(keys.size());
+      auto idx = index.size();
+      for (auto &[h, pos]: keys)
+      {
+        index.emplace_back(h);
+        index.emplace_back(pos);
+      }
+      tape[block_end(block)] = entry(type_at(block_end(block)), idx);
+    }
+    
+    template<typename T>
+    void add_basic(const T &v)
+    {
+      if constexpr (std::is_same_v<T, value::Null>)
+      {
+        tape.emplace_back(entry(Type::NUL));
+      }
+      else if constexpr (std::is_same_v<T, int>)
+      {
+        tape.emplace_back(entry(Type::INT, static_cast<std::uint32_t>(v)));
+      }
+      else if constexpr (std::is_same_v<T, long long>)
+      {
+        tape.emplace_back(entry(Type::LONG_LONG));
+        tape.emplace_back(static_cast<std::uint64_t>(v));
+      }
+      else if constexpr (std::is_same_v<T, double>)
+      {
+        tape.emplace_back(entry(Type::DOUBLE));
+        tape.emplace_back(std::bit_cast<std::uint64_t>(v));
+      }
+      else if constexpr (std::is_same_v<T, bool>)
+      {
+        tape.emplace_back(entry(v ? Type::TRUE : Type::FALSE));
+      }
+      else if constexpr (std::is_same_v<T, std::string>)
+      {
+        tape.emplace_back(entry(Type::STRING, add_string(v)));
+      }
+      else
+      {
+        error::czh_unreachable();
+      }
+    }
+    
+    // Resolves every reference to its final non-reference target.
+    void link(const std::vector<PendingRef> &refs)
+    {
+      std::unordered_map<std::size_t, const PendingRef *> ref_at;
+      for (auto &ref: refs)
+      {
+        ref_at[ref.pos] = &ref;
+        tape[ref.pos] = entry(Type::REFERENCE, resolve(ref));
+      }
+      enum class State : std::uint8_t { unvisited, visiting, done };
+      std::unordered_map<std::size_t, State> states;
+      std::vector<std::size_t> chain;
+      for (auto &ref: refs)
+      {
+        auto pos = ref.pos;
+        while (type_at(pos) == Type::REFERENCE && states[pos] != State::done)
+        {
+          if (states[pos] == State::visiting)
+          {
+            ref_at[pos]->token.report_error("Circular reference.");
+          }
+          states[pos] = State::visiting;
+          chain.emplace_back(pos);
+          pos = payload_at(pos);
+        }
+        if (type_at(pos) == Type::REFERENCE) pos = payload_at(pos);
+        for (auto &r: chain)
+        {
+          tape[r] = entry(Type::REFERENCE, pos);
+          states[r] = State::done;
+        }
+        chain.clear();
+      }
+    }
+    
+    std::size_t resolve(const PendingRef &ref) const
+    {
+      // A global reference is only looked up from the root.
+      for (auto i = ref.global ? 1 : ref.blocks.size(); i-- > 0;)
+      {
+        auto pos = ref.blocks[i];
+        for (auto &name: ref.path)
+        {
+          if (!is_block(pos))
+          {
+            pos = 0;
+            break;
+          }
+          pos = find(pos, name);
+          if (pos == 0) break;
+        }
+        if (pos != 0) return pos;
+      }
+      ref.token.report_error("Unknown reference.");
+      return 0;
+    }
+    
+    [[nodiscard]] bool is_block(std::size_t pos) const
+    {
+      return type_at(pos) == Type::ROOT || type_at(pos) == Type::BLOCK_BEG;
+    }
+    
+    [[nodiscard]] value::details::BasicVT basic_value_at(std::size_t pos) const
+    {
+      switch (type_at(pos))
+      {
+        case Type::NUL:
+          return value::Null();
+        case Type::INT:
+          return static_cast<int>(static_cast<std::uint32_t>(payload_at(pos)));
+        case Type::LONG_LONG:
+          return static_cast<long long>(tape[pos + 1]);
+        case Type::DOUBLE:
+          return std::bit_cast<double>(tape[pos + 1]);
+        case Type::TRUE:
+          return true;
+        case Type::FALSE:
+          return false;
+        case Type::STRING:
+          return std::string(string_at(payload_at(pos)));
+        default:
+          error::czh_unreachable();
+      }
+      return {};
+    }
+  };
+  
+  class ElementView
+  {
+  private:
+    const Tape *doc;
+    std::size_t pos;
+  public:
+    class iterator
+    {
+    private:
+      const Tape *doc;
+      std::size_t pos;// at the KEY
+    public:
+      iterator(const Tape *doc_, std::size_t pos_) : doc(doc_), pos(pos_) {}
+      
+      ElementView operator*() const { return {doc, pos + 1}; }
+      
+      iterator &operator++()
+      {
+        pos = doc->next(pos + 1);
+        return *this;
+      }
+      
+      bool operator==(const iterator &it) const { return pos == it.pos; }
+    };
+    
+    ElementView(const Tape *doc_, std::size_t pos_) : doc(doc_), pos(pos_) {}
+    
+    [[nodiscard]] std::string_view get_name() const
+    {
+      if (pos == 0) return {};
+      return doc->string_at(doc->payload_at(pos - 1));
+    }
+    
+    [[nodiscard]] bool is_node() const
+    {
+      return doc->is_block(pos);
+    }
+    
+    // Node only
+    [[nodiscard]] bool has_node(std::string_view name, const std::source_location &l =
+    std::source_location::current()) const
+    {
+      assert_node(l);
+      return doc->find(pos, name) != 0;
+    }
+    
+    [[nodiscard]] iterator begin(const std::source_location &l =
+    std::source_location::current()) const
+    {
+      assert_node(l);
+      return {doc, pos + 1};
+    }
+    
+    [[nodiscard]] iterator end(const std::source_location &l =
+    std::source_location::current()) const
+    {
+      assert_node(l);
+      return {doc, doc->block_end(pos)};
+    }
+    
+    ElementView operator()(std::string_view name, const std::source_location &l =
+    std::source_location::current()) const
+    {
+      assert_node(l);
+      auto ret = doc->find(pos, name);
+      if (ret == 0)
+      {
+        throw error::Error("There is no node named '" + std::string(name) + "'.", l);
+      }
+      return {doc, ret};
+    }
+    
+    ElementView operator[](std::string_view name) const
+    {
+      return operator()(name);
+    }
+    
+    // Value only
+    template<typename T>
+    [[nodiscard]] bool is(const std::source_location &l =
+    std::source_location::current()) const
+    {
+      assert_value(l);
+      switch (doc->type_at(pos))
+      {
+        case Type::NUL:
+          return std::is_same_v<T, value::Null>;
+        case Type::INT:
+          return std::is_same_v<T, int>;
+        case Type::LONG_LONG:
+          return std::is_same_v<T, long long>;
+        case Type::DOUBLE:
+          return std::is_same_v<T, double>;
+        case Type::TRUE:
+        case Type::FALSE:
+          return std::is_same_v<T, bool>;
+        case Type::STRING:
+          return std::is_same_v<T, std::string>;
+        case Type::ARRAY_BEG:
+          return std::is_same_v<T, value::Array>;
+        case Type::REFERENCE:
+          return std::is_same_v<T, value::Reference>;
+        default:
+          error::czh_unreachable();
+      }
+      return false;
+    }
+    
+    [[nodiscard]] value::Value get_value(const std::source_location &l =
+    std::source_location::current()) const
+    {
+      assert_value(l);
+      switch (doc->type_at(pos))
+      {
+        case Type::ARRAY_BEG:
+        {
+          value::Array arr;
+          for (auto p = pos + 1; doc->type_at(p) != Type::ARRAY_END; p = doc->next(p))
+          {
+            arr.emplace_back(doc->basic_value_at(p));
+          }
+          return value::Value(std::move(arr));
+        }
+        case Type::REFERENCE:
+        {
+          std::vector<std::string> path;
+          auto str = doc->string_at(doc->tape[pos + 1]);
+          for (std::size_t beg = 0, end; beg <= str.size(); beg = end + 2)
+          {
+            end = (std::min)(str.find("::", beg), str.size());
+            path.insert(path.begin(), std::string(str.substr(beg, end - beg)));
+          }
+          return value::Value(value::Reference(std::move(path)));
+        }
+        default:
+          return std::visit([](auto &&v) { return value::Value(v); }, doc->basic_value_at(pos));
+      }
+    }
+    
+    template<typename T>
+    T get(const std::source_location &l =
+    std::source_location::current()) const
+    {
+      assert_value(l);
+      if (doc->type_at(pos) == Type::REFERENCE && !std::is_same_v<T, value::Reference>)
+      {
+        return ElementView(doc, doc->payload_at(pos)).get<T>(l);
+      }
+      if constexpr (std::is_same_v<T, int>)
+      {
+        if (doc->type_at(pos) == Type::INT)
+          return static_cast<int>(static_cast<std::uint32_t>(doc->payload_at(pos)));
+      }
+      else if constexpr (std::is_same_v<T, double>)
+      {
+        if (doc->type_at(pos) == Type::DOUBLE)
+          return std::bit_cast<double>(doc->tape[pos + 1]);
+      }
+      else if constexpr (std::is_same_v<T, bool>)
+      {
+        if (doc->type_at(pos) == Type::TRUE || doc->type_at(pos) == Type::FALSE)
+          return doc->type_at(pos) == Type::TRUE;
+      }
+      else if constexpr (std::is_same_v<T, std::string_view>)
+      {
+        error::czh_assert(doc->type_at(pos) == Type::STRING, "The value is not 'std::string'.", l);
+        return doc->string_at(doc->payload_at(pos));
+      }
+      if constexpr (!std::is_same_v<T, std::string_view>)
+      {
+        return get_value(l).template get<T>(l);
+      }
+    }
+  
+  private:
+    void assert_node(const std::source_location &l) const
+    {
+      error::czh_assert(is_node(), "This Node is not a node.", l);
+    }
+    
+    void assert_value(const std::source_location &l) const
+    {
+      error::czh_assert(!is_node(), "This Node is not a value.", l);
+    }
+  };
+  
+  ElementView Tape::root() const
+  {
+    return {this, 0};
+  }
+  
+  class TapeParser
+  {
+  private:
+    struct Block
+    {
+      std::size_t pos;
+      std::unordered_set<std::string> names;
+    };
+    lexer::Lexer *lex;
+    Tape doc;
+    std::vector<Block> blocks;
+    std::vector<Tape::PendingRef> refs;
+    token::Token curr_tok;
+  public:
+    explicit TapeParser(lexer::Lexer *lex_)
+        : lex(lex_), curr_tok(token::TokenType::UNEXPECTED, 0, token::Pos(nullptr)) {}
+    
+    Tape parse()
+    {
+      doc.tape.emplace_back(Tape::entry(Type::ROOT));
+      blocks.push_back(Block{0, {}});
+      curr_tok = get();
+      error::czh_assert(curr_tok.type != token::TokenType::FEND, "Unexpected end of czh.");
+      while (check())
+      {
+        if (curr_tok.type == token::TokenType::FEND) break;
+        switch (curr_tok.type)
+        {
+          case token::TokenType::ID:
+            parse_id();
+            break;
+          case token::TokenType::SCEND:
+            parse_end();
+            break;
+          case token::TokenType::SEND:
+            curr_tok = get();
+            break;
+          default:
+            error::czh_unreachable("Unexpected token");
+            break;
+        }
+      }
+      while (blocks.size() > 1)
+      {
+        close_block();
+      }
+      doc.tape.emplace_back(Tape::entry(Type::ROOT));
+      doc.tape[0] = Tape::entry(Type::ROOT, doc.tape.size());
+      doc.build_index(0);
+      doc.link(refs);
+      blocks.clear();
+      refs.clear();
+      return std::move(doc);
+    }
+  
+  private:
+    void parse_end()
+    {
+      if (blocks.size() == 1)
+      {
+        curr_tok.report_error("Unexpected scope end.");
+      }
+      close_block();
+      if (check())
+      {
+        curr_tok = get();
+      }
+    }
+    
+    void close_block()
+    {
+      auto beg = blocks.back().pos;
+      doc.tape.emplace_back(Tape::entry(Type::BLOCK_END));
+      doc.tape[beg] = Tape::entry(Type::BLOCK_BEG, doc.tape.size());
+      blocks.pop_back();
+    }
+    
+    void parse_id()
+    {
+      if (!check()) return;
+      auto id_name = curr_tok.what.get<std::string>();
+      if (!blocks.back().names.insert(id_name).second) curr_tok.report_error("Duplicate node name.");
+      auto bak = token::Token(curr_tok);
+      curr_tok = get();//eat name
+      doc.tape.emplace_back(Tape::entry(Type::KEY, doc.add_string(id_name)));
+      // id:
+      if (curr_tok.type == token::TokenType::COLON)//scope
+      {
+        curr_tok = get();//eat ':'
+        blocks.push_back(Block{doc.tape.size(), {}});
+        doc.tape.emplace_back(Tape::entry(Type::BLOCK_BEG));
+        return;
+      }
+      //id = xxx
+      curr_tok = get();//eat '='
+      if (curr_tok.type == token::TokenType::ID || curr_tok.type == token::TokenType::REF)//ref id = -x:x
+      {
+        parse_ref(std::move(bak));
+        return;
+      }
+      else if (curr_tok.type == token::TokenType::ARR_LP)// array id = [1,2,3]
+      {
+        parse_array();
+        return;
+      }
+      add_value(curr_tok.what);
+      curr_tok = get();//eat value
+    }
+    
+    void parse_ref(token::Token token)
+    {
+      Tape::PendingRef ref{doc.tape.size(), {}, {}, curr_tok.type == token::TokenType::REF, std::move(token)};
+      std::string str = ref.global ? "::" : "";
+      bool id = false;
+      while (curr_tok.type == token::TokenType::ID || curr_tok.type == token::TokenType::REF)
+      {
+        if (curr_tok.type == token::TokenType::ID)
+        {
+          if (id) break;// double id
+          ref.path.emplace_back(curr_tok.what.get<std::string>());
+          str += ref.path.back();
+          id = true;
+        }
+        else
+        {
+          if (id) str += "::";
+          id = false;
+        }
+        curr_tok = get();
+      }
+      for (auto &r: blocks)
+      {
+        ref.blocks.emplace_back(r.pos);
+      }
+      doc.tape.emplace_back(Tape::entry(Type::REFERENCE));
+      doc.tape.emplace_back(doc.add_string(str));
+      refs.emplace_back(std::move(ref));
+    }
+    
+    void parse_array()
+    {
+      auto beg = doc.tape.size();
+      doc.tape.emplace_back(Tape::entry(Type::ARRAY_BEG));
+      curr_tok = get();//eat [
+      for (; curr_tok.type != token::TokenType::ARR_RP; curr_tok = get())
+      {
+        if (curr_tok.type == token::TokenType::COMMA) continue;
+        add_value(curr_tok.what);
+      }
+      doc.tape.emplace_back(Tape::entry(Type::ARRAY_END));
+      doc.tape[beg] = Tape::entry(Type::ARRAY_BEG, doc.tape.size());
+      curr_tok = get();//eat ]
+    }
+    
+    void add_value(const value::Value &v)
+    {
+      std::visit([this](auto &&val) { doc.add_basic(val); }, value::details::stored(v));
+    }
+    
+    bool check()
+    {
+      return !lex->eof();
+    }
+    
+    token::Token get()
+    {
+      return lex->get();
+    }
+  };
+  
+  // Builds a Tape from a Node tree.
+  class Freezer
+  {
+  private:
+    Tape doc;
+    std::vector<std::size_t> blocks;
+    std::vector<Tape::PendingRef> refs;
+  public:
+    Tape freeze(const node::Node &node, const std::source_location &l =
+    std::source_location::current())
+    {
+      error::czh_assert(node.is_node(), "Only a node can be frozen.", l);
+      doc.tape.emplace_back(Tape::entry(Type::ROOT));
+      blocks.emplace_back(0);
+      add_block(node);
+      doc.tape.emplace_back(Tape::entry(Type::ROOT));
+      doc.tape[0] = Tape::entry(Type::ROOT, doc.tape.size());
+      doc.build_index(0);
+      doc.link(refs);
+      blocks.clear();
+      refs.clear();
+      return std::move(doc);
+    }
+  
+  private:
+    void add_block(const node::Node &node)
+    {
+      for (auto it = node.cbegin(); it != node.cend(); ++it)
+      {
+        doc.tape.emplace_back(Tape::entry(Type::KEY, doc.add_string(it->get_name())));
+        if (it->is_node())
+        {
+          auto beg = doc.tape.size();
+          blocks.emplace_back(beg);
+          doc.tape.emplace_back(Tape::entry(Type::BLOCK_BEG));
+          add_block(*it);
+          doc.tape.emplace_back(Tape::entry(Type::BLOCK_END));
+          doc.tape[beg] = Tape::entry(Type::BLOCK_BEG, doc.tape.size());
+          blocks.pop_back();
+        }
+        else
+        {
+          add_value(*it);
+        }
+      }
+    }
+    
+    void add_value(const node::Node &node)
+    {
+      auto &v = node.get_value();
+      if (v.is<value::Reference>())
+      {
+        add_ref(node, v.view<value::Reference>());
+      }
+      else if (v.is<value::Array>())
+      {
+        auto beg = doc.tape.size();
+        doc.tape.emplace_back(Tape::entry(Type::ARRAY_BEG));
+        v.visit_array([this](auto &&arr)
+                      {
+                        using E = typename std::decay_t<decltype(arr)>::value_type;
+                        for (auto &&e: arr)
+                        {
+                          if constexpr (std::is_same_v<E, value::details::BasicVT>)
+                          {
+                            std::visit([this](auto &&b) { doc.add_basic(b); }, e);
+                          }
+                          else
+                          {
+                            doc.add_basic(static_cast<E>(e));
+                          }
+                        }
+                      });
+        doc.tape.emplace_back(Tape::entry(Type::ARRAY_END));
+        doc.tape[beg] = Tape::entry(Type::ARRAY_BEG, doc.tape.size());
+      }
+      else
+      {
+        std::visit([this](auto &&val) { doc.add_basic(val); }, value::details::stored(v));
+      }
+    }
+    
+    // A Reference's path is stored from the end, and a global one ends with "".
+    void add_ref(const node::Node &node, const value::Reference &ref)
+    {
+      Tape::PendingRef pending{doc.tape.size(), blocks, {}, ref.path.back().empty(),
+                                 token::Token(node.get_token())};
+      std::string str = pending.global ? "::" : "";
+      for (auto it = ref.path.crbegin() + (pending.global ? 1 : 0); it != ref.path.crend(); ++it)
+      {
+        if (!pending.path.empty()) str += "::";
+        str += *it;
+        pending.path.emplace_back(*it);
+      }
+      doc.tape.emplace_back(Tape::entry(Type::REFERENCE));
+      doc.tape.emplace_back(doc.add_string(str));
+      refs.emplace_back(std::move(pending));
+    }
+  };
+  
+  // Converts a Node tree into a compact read-only Tape. References are resolved to
+  // the final non-reference values.
+  inline Tape freeze(const node::Node &node, const std::source_location &l =
+  std::source_location::current())
+  {
+    return Freezer().freeze(node, l);
+  }
+}
+#endif
\ No newline at end of file
@@ -45,12 +45,14 @@ namespace czh::token
   public:
     std::size_t pos;
     std::size_t size;
+    // The version of the code which pos refers to.
+    std::size_t version;
     std::shared_ptr<file::File> code;
   public:
     explicit Pos(std::shared_ptr<file::File> code_)
-        : pos(0), size(0), code(std::move(code_)) {}
+        : pos(0), size(0), version(code_ == nullptr ? 0 : code_->version()), code(std::move(code_)) {}
   
-    explicit Pos() : pos(0), size(0) {}
+    explicit Pos() : pos(0), size(0), version(0) {}
   
     void reset()
     {
@@ -70,9 +72,23 @@ namespace czh::token
       return *this;
     }
     
+    // pos in the current code, after the edits made since this Pos was taken.
+    [[nodiscard]] std::size_t current() const
+    {
+      return code == nullptr ? pos : code->current_pos(pos, size, version);
+    }
+    
+    // Moves pos to the current code.
+    void update()
+    {
+      if (code == nullptr) return;
+      pos = current();
+      version = code->version();
+    }
+    
     [[nodiscard]] std::string location() const
     {
-      return (code->get_name() + ":line " + utils::to_str(code->get_lineno(pos)));
+      return (code->get_name() + ":line " + utils::to_str(code->get_lineno(current())));
     }
     
     [[nodiscard]] std::size_t get() const
@@ -89,7 +105,8 @@ namespace czh::token
   
     [[nodiscard]] std::string get_code() const
     {
-      std::size_t lineno = code->get_lineno(pos);
+      auto at = current();
+      std::size_t lineno = code->get_lineno(at);
       std::size_t linenosize = utils::to_str(lineno + next).size();
       std::size_t actual_last = last;
       std::size_t actual_next = next;
@@ -112,7 +129,7 @@ namespace czh::token
         temp2 = code->get_spec_line(lineno + 1, lineno + actual_next + 1, linenosize);
       }
       std::string arrow("\n");
-      std::size_t arrowpos = code->get_arrowpos(pos) - size + linenosize;
+      std::size_t arrowpos = code->get_arrowpos(at) - size + linenosize;
       arrow += std::string(arrowpos, ' ');
       arrow += "\033[0;32;32m";
       arrow.insert(arrow.end(), size, '^');
@@ -163,7 +180,7 @@ namespace czh::token
                 if (type == TokenType::VALUE) return czh::utils::to_czhstr(i);
                 return std::string(1, static_cast<char>(i));
               }
-          }, what.get_variant());
+          }, value::details::stored(what));
     }
   };
 }
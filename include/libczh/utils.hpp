@@ -201,6 +201,23 @@ namespace czh::utils
     return result;
   }
   
+  template<>
+  std::string to_czhstr(const value::details::PackedArray &v, Color color)
+  {
+    return std::visit([&color](auto &&arr)
+    {
+      using E = typename std::decay_t<decltype(arr)>::value_type;
+      std::string result = "{";
+      for (auto it = arr.cbegin(); it != arr.cend(); ++it)
+      {
+        if (it != arr.cbegin()) result += ",";
+        result += to_czhstr(static_cast<E>(*it), color);
+      }
+      result += "}";
+      return result;
+    }, v);
+  }
+  
   int get_string_edit_distance(const std::string &s1, const std::string &s2)
   {
     std::size_t n = s1.size();
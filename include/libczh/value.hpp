@@ -16,7 +16,10 @@
 #pragma once
 
 #include "error.hpp"
+#include <algorithm>
 #include <variant>
+#include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
 #include <typeinfo>
@@ -27,6 +30,8 @@
 #include <queue>
 #include <array>
 #include <list>
+#include <optional>
+#include <span>
 
 namespace czh
 {
@@ -211,9 +216,18 @@ namespace czh
   
       using Array = std::vector<BasicVT>;//insert() begin() end()
       
+      // An Array whose elements have the same type is stored packed.
+      // It is only used inside Value, and is seen as an Array from outside.
+      using PackedVTList = TypeList<int, long long, double, bool, std::string>;
+      using PackedArray = std::variant<std::vector<int>, std::vector<long long>, std::vector<double>,
+          std::vector<bool>, std::vector<std::string>>;
+      
       using HighVTList = TypeList<Reference, Array>;
       using VTList = link_t<BasicVTList, HighVTList>;
       using VT = decltype(as_variant(VTList{}));
+      // What a Value stores, which is VT with the packed form.
+      using StoredVT = decltype(as_variant(link_t<VTList, TypeList<PackedArray>>{}));
+      constexpr size_t packed_array_index = size_of_v<VTList>;
   
       template<typename T>
       consteval std::string_view nameof()
@@ -224,11 +238,36 @@ namespace czh
         return str.substr(b + 1, e - b - 1);
       }
       
+      // Mixes h into seed, like boost::hash_combine. h is scrambled first, as std::hash
+      // of an integer is usually the integer itself.
+      inline size_t hash_combine(size_t seed, size_t h)
+      {
+        auto x = static_cast<std::uint64_t>(h);
+        x = (x ^ (x >> 33)) * 0xff51afd7ed558ccdull;
+        x = (x ^ (x >> 33)) * 0xc4ceb9fe1a85ec53ull;
+        x ^= x >> 33;
+        return seed ^ static_cast<size_t>(x + 0x9e3779b97f4a7c15ull + (seed << 6) + (seed >> 2));
+      }
+      
+      // Hashes the type with the value, so 1 and 1ll differ as they do in operator==.
+      template<typename T>
+      size_t hash_basic(const T &v)
+      {
+        if constexpr (std::is_same_v<T, Null>)
+        {
+          return index_of_v<T, BasicVTList>;
+        }
+        else
+        {
+          return hash_combine(index_of_v<T, BasicVTList>, std::hash<T>{}(v));
+        }
+      }
+      
       std::string get_typename(size_t sz)
       {
         static std::vector<std::string>
             names{"Null", "int", "long long", "double", "bool", "std::string", "czh::value::Reference",
-                  "czh::value::Array"};
+                  "czh::value::Array", "czh::value::Array"};
         return names[sz];
       }
       
@@ -304,6 +343,17 @@ namespace czh
             std::conditional_t<is_czh_container_v<T>,
                 std::conditional_t<std::is_array_v<T>, CppArrayTag, NormalArrayTag>, ValueTag>>;
       };
+      
+      template<typename T>
+      struct is_span : std::false_type {};
+      template<typename E>
+      struct is_span<std::span<const E>> : std::true_type {};
+      template<typename T>
+      constexpr bool is_span_v = is_span<T>::value;
+      
+      // What Value::view<T>() returns: a std::span<const E> itself, or a const T&.
+      template<typename T>
+      using view_t = std::conditional_t<is_span_v<T>, T, const T &>;
     }
     using details::Array;
   
@@ -313,6 +363,11 @@ namespace czh
     concept CzhGetType = details::is_czh_type_v<T> ||
                          (details::is_czh_container_v<T> && !std::is_array_v<std::decay_t<T>>);
   
+    // What view<T>() can return without copying. An Array may be stored packed, so it is
+    // viewed as std::span<const E>, or read with visit_array().
+    template<typename T>
+    concept CzhViewType = !std::is_same_v<T, details::Array>;
+  
     class Value;
   
     template<typename T>
@@ -322,10 +377,20 @@ namespace czh
                             && (!std::is_same_v<char *, std::remove_cvref_t<std::decay_t<T>>>);
     // char* should be converted to std::string.
   
+    class ArrayBuilder;
+    
+    namespace details
+    {
+      // The stored variant, for the visitors in libczh which handle PackedArray themselves.
+      inline const StoredVT &stored(const Value &v);
+    }
+    
     class Value
     {
+      friend class ArrayBuilder;
+      friend const details::StoredVT &details::stored(const Value &v);
     private:
-      details::VT value;
+      details::StoredVT value;
     public:
       template<CzhAssignType T>
       explicit Value(T &&data)
@@ -345,6 +410,12 @@ namespace czh
     
       bool operator==(const Value &v) const
       {
+        auto p1 = std::get_if<details::PackedArray>(&value);
+        auto p2 = std::get_if<details::PackedArray>(&v.value);
+        if ((p1 || p2) && !(p1 && p2 && p1->index() == p2->index()))
+        {
+          return is<Array>() && v.is<Array>() && get<Array>() == v.get<Array>();
+        }
         return value == v.value;
       }
     
@@ -371,6 +442,10 @@ namespace czh
       template<CzhValueType T>
       [[nodiscard]]bool is() const
       {
+        if constexpr (std::is_same_v<T, Array>)
+        {
+          if (value.index() == details::packed_array_index) return true;
+        }
         return value.index() == details::index_of_v<T, details::VTList>;
       }
     
@@ -380,22 +455,145 @@ namespace czh
         return internal_can_get<T>(typename details::TagDispatch<T>::tag{});
       }
     
-      [[nodiscard]] auto get_variant() const
+      // A copy of the value, in which a packed Array is unpacked.
+      // Use view<T>() or visit_array() to read it without copying.
+      [[nodiscard]] details::VT get_variant() const
       {
-        return value;
+        return std::visit([this](auto &&v) -> details::VT
+        {
+          if constexpr (std::is_same_v<std::decay_t<decltype(v)>, details::PackedArray>)
+          {
+            return get<Array>();
+          }
+          else
+          {
+            return v;
+          }
+        }, value);
       }
     
       [[nodiscard]] std::string get_typename() const { return details::get_typename(value.index()); }
+    
+      // Calls f with the elements of an Array, which is either an Array or a packed
+      // std::vector of int, long long, double, bool or std::string.
+      template<typename F>
+      decltype(auto) visit_array(F &&f, const std::source_location &l =
+      std::source_location::current()) const
+      {
+        if (!is<Array>()) get_error_index<Array>(l);
+        if (auto packed = std::get_if<details::PackedArray>(&value))
+        {
+          return std::visit(std::forward<F>(f), *packed);
+        }
+        return std::forward<F>(f)(std::get<Array>(value));
+      }
+      
+      // Returns the value without copying it. T is a basic type, or std::span<const E> over
+      // an Array of E, which is stored packed when it is parsed or assigned from a container
+      // of E. A packed Array of bool can not be viewed, as std::vector<bool> is not contiguous.
+      template<CzhViewType T>
+      [[nodiscard]] details::view_t<T> view(const std::source_location &l =
+      std::source_location::current()) const
+      {
+        if constexpr (details::is_span_v<T>)
+        {
+          using E = std::remove_const_t<typename T::element_type>;
+          static_assert(details::contains_v<E, details::PackedVTList> && !std::is_same_v<E, bool>,
+                        "Only an Array of int, long long, double or std::string can be viewed.");
+          if (auto packed = std::get_if<details::PackedArray>(&value))
+          {
+            if (auto arr = std::get_if<std::vector<E>>(packed)) return T(arr->data(), arr->size());
+          }
+          if (!is<Array>()) get_error_index<Array>(l);
+          if (visit_array([](auto &&arr) { return arr.empty(); }, l)) return T();
+          throw error::Error("The array is not packed as '" + std::string(details::nameof<E>())
+                             + "'. Requires from " + error::location_to_str(l));
+        }
+        else
+        {
+          static_assert(details::contains_v<T, details::VTList>, "T must be a czh type.");
+          if (!is<T>()) get_error_index<T>(l);
+          return std::get<T>(value);
+        }
+      }
+    
+      // Equal Values have equal hashes, whether an Array is packed or not.
+      // A Reference is hashed by its path as written, as it is compared.
+      [[nodiscard]] size_t hash() const
+      {
+        if (is<Array>())
+        {
+          size_t seed = details::index_of_v<Array, details::VTList>;
+          visit_array([&seed](auto &&arr)
+          {
+            using E = typename std::decay_t<decltype(arr)>::value_type;
+            for (auto it = arr.cbegin(); it != arr.cend(); ++it)
+            {
+              if constexpr (std::is_same_v<E, details::BasicVT>)
+              {
+                seed = details::hash_combine(seed, std::visit([](auto &&e) { return details::hash_basic(e); }, *it));
+              }
+              else if constexpr (std::is_same_v<E, bool>)
+              {
+                seed = details::hash_combine(seed, details::hash_basic(static_cast<bool>(*it)));
+              }
+              else
+              {
+                seed = details::hash_combine(seed, details::hash_basic(*it));
+              }
+            }
+          });
+          return seed;
+        }
+        if (auto ref = std::get_if<Reference>(&value))
+        {
+          size_t seed = details::index_of_v<Reference, details::VTList>;
+          for (auto &r: ref->path) seed = details::hash_combine(seed, std::hash<std::string>{}(r));
+          return seed;
+        }
+        return std::visit([](auto &&v) -> size_t
+        {
+          using T = std::decay_t<decltype(v)>;
+          if constexpr (details::contains_v<T, details::BasicVTList>)
+          {
+            return details::hash_basic(v);
+          }
+          else
+          {
+            // Arrays and References are hashed above.
+            return 0;
+          }
+        }, value);
+      }
   
     private:
+      explicit Value(details::PackedArray &&packed) : value(std::move(packed)) {}
+    
       template<CzhGetType T>
       [[nodiscard]] bool internal_can_get(details::ValueTag) const { return is<T>(); }
     
       template<CzhGetType T>
       [[nodiscard]] bool internal_can_get(details::AnyArrayTag) const { return is<Array>(); }
     
+      // All the elements must be of the element type of T, as get<T>() does not convert them.
       template<CzhGetType T>
-      [[nodiscard]] bool internal_can_get(details::NormalArrayTag) const { return is<Array>(); }
+      [[nodiscard]] bool internal_can_get(details::NormalArrayTag) const
+      {
+        if (!is<Array>()) return false;
+        return visit_array([](auto &&arr)
+        {
+          using E = typename std::decay_t<decltype(arr)>::value_type;
+          if constexpr (std::is_same_v<E, details::BasicVT>)
+          {
+            return std::all_of(arr.cbegin(), arr.cend(),
+                               [](auto &&r) { return std::holds_alternative<typename T::value_type>(r); });
+          }
+          else
+          {
+            return arr.empty() || std::is_same_v<E, typename T::value_type>;
+          }
+        });
+      }
     
       template<CzhGetType T>
       [[nodiscard]]T internal_get(details::ValueTag, const std::source_location &l) const
@@ -415,20 +613,62 @@ namespace czh
         }
       }
     
+      template<CzhGetType T>
+      void narrow_transfrom_to_container(const details::PackedArray &from, T &to) const
+      {
+        std::visit([&to](auto &&arr)
+        {
+          using E = typename std::decay_t<decltype(arr)>::value_type;
+          if (arr.empty()) return;
+          error::czh_assert(std::is_same_v<E, typename T::value_type>, "This array contains different types.");
+          if constexpr (std::is_same_v<std::decay_t<decltype(arr)>, T>)
+          {
+            to = arr;
+          }
+          else if constexpr (std::is_same_v<E, typename T::value_type>)
+          {
+            for (auto &&r: arr)
+            {
+              to.insert(std::end(to), r);
+            }
+          }
+        }, from);
+      }
+    
       template<CzhGetType T>
       [[nodiscard]]T internal_get(details::NormalArrayTag, const std::source_location &l) const
       {
         if (!is<Array>()) get_error_index<T>(l);
-        auto &varr = std::get<Array>(value);
         T ret;
-        narrow_transfrom_to_container(varr, ret);
-        return std::move(ret);
+        if (auto packed = std::get_if<details::PackedArray>(&value))
+        {
+          narrow_transfrom_to_container(*packed, ret);
+        }
+        else
+        {
+          narrow_transfrom_to_container(std::get<Array>(value), ret);
+        }
+        return ret;
       }
     
       template<CzhGetType T>
       [[nodiscard]]Array internal_get(details::AnyArrayTag, const std::source_location &l) const
       {
         if (!is<Array>()) get_error_index<T>(l);
+        if (auto packed = std::get_if<details::PackedArray>(&value))
+        {
+          return std::visit([](auto &&arr)
+          {
+            using E = typename std::decay_t<decltype(arr)>::value_type;
+            Array ret;
+            ret.reserve(arr.size());
+            for (auto &&r: arr)
+            {
+              ret.emplace_back(static_cast<E>(r));
+            }
+            return ret;
+          }, *packed);
+        }
         return std::get<Array>(value);
       }
     
@@ -441,23 +681,45 @@ namespace czh
       template<CzhAssignType T>
       void internal_assign(T &&v, details::NormalArrayTag)
       {
-        Array tmp;
-        for (auto r: v)
+        using E = std::remove_cvref_t<decltype(*std::begin(v))>;
+        if constexpr (details::contains_v<E, details::PackedVTList>)
         {
-          tmp.emplace_back(std::move(r));
+          std::vector<E> tmp;
+          for (auto r: v)
+          {
+            tmp.emplace_back(std::move(r));
+          }
+          value.template emplace<details::PackedArray>(std::move(tmp));
+        }
+        else
+        {
+          Array tmp;
+          for (auto r: v)
+          {
+            tmp.emplace_back(std::move(r));
+          }
+          value = std::move(tmp);
         }
-        value = std::move(tmp);
       }
     
       template<CzhAssignType T>
       void internal_assign(T &&v, details::CppArrayTag)
       {
-        Array tmp;
-        for (size_t i = 0; i < details::size_of_array_v<T>; ++i)
+        using E = std::remove_cvref_t<decltype(v[0])>;
+        if constexpr (details::contains_v<E, details::PackedVTList>)
+        {
+          std::vector<E> tmp(std::begin(v), std::end(v));
+          value.template emplace<details::PackedArray>(std::move(tmp));
+        }
+        else
         {
-          tmp.emplace_back(v[i]);
+          Array tmp;
+          for (size_t i = 0; i < details::size_of_array_v<std::remove_cvref_t<T>>; ++i)
+          {
+            tmp.emplace_back(v[i]);
+          }
+          value = std::move(tmp);
         }
-        value = std::move(tmp);
       }
     
       template<CzhGetType T>
@@ -469,6 +731,78 @@ namespace czh
                            + "'], Requires from " + error::location_to_str(l));
       }
     };
+    
+    // Builds an Array element by element. The Array is packed as long as all
+    // the elements have the same type.
+    class ArrayBuilder
+    {
+    private:
+      std::optional<details::PackedArray> packed;
+      Array mixed;
+    public:
+      template<typename T>
+      void add(T &&v)
+      {
+        using U = std::remove_cvref_t<T>;
+        if constexpr (details::contains_v<U, details::PackedVTList>)
+        {
+          if (mixed.empty())
+          {
+            if (!packed) packed.emplace(std::in_place_type<std::vector<U>>);
+            if (auto p = std::get_if<std::vector<U>>(&*packed))
+            {
+              p->emplace_back(std::forward<T>(v));
+              return;
+            }
+          }
+        }
+        unpack();
+        mixed.emplace_back(std::forward<T>(v));
+      }
+      
+      Value get()
+      {
+        if (packed) return Value(std::move(*packed));
+        return Value(std::move(mixed));
+      }
+    
+    private:
+      void unpack()
+      {
+        if (!packed) return;
+        std::visit([this](auto &&arr)
+        {
+          using E = typename std::decay_t<decltype(arr)>::value_type;
+          mixed.reserve(arr.size() + 1);
+          for (auto &&r: arr)
+          {
+            if constexpr (std::is_same_v<E, bool>)
+            {
+              mixed.emplace_back(static_cast<bool>(r));
+            }
+            else
+            {
+              mixed.emplace_back(std::move(r));
+            }
+          }
+        }, *packed);
+        packed.reset();
+      }
+    };
+    
+    inline const details::StoredVT &details::stored(const Value &v)
+    {
+      return v.value;
+    }
   }
 }
+
+template<>
+struct std::hash<czh::value::Value>
+{
+  size_t operator()(const czh::value::Value &v) const
+  {
+    return v.hash();
+  }
+};
 #endif
\ No newline at end of file
@@ -37,6 +37,35 @@ namespace czh::writer
     { w.value_array_end() };
   };
   
+  // Writes a Value which is not a Reference, element by element if it is an Array.
+  template<Writer W>
+  void accept_value(W &writer, const value::Value &value)
+  {
+    if (!value.is<value::Array>())
+    {
+      writer.value(value);
+      return;
+    }
+    writer.value_array_begin();
+    value.visit_array([&writer](auto &&arr)
+    {
+      using E = typename std::decay_t<decltype(arr)>::value_type;
+      for (auto it = arr.cbegin(); it < arr.cend(); ++it)
+      {
+        if (it + 1 == arr.cend()) break;
+        writer.value_array_value(value::Array::value_type(static_cast<E>(*it)));
+      }
+      if (!arr.empty())
+      {
+        writer.value_array_end(value::Array::value_type(static_cast<E>(*arr.crbegin())));
+      }
+      else
+      {
+        writer.value_array_end();
+      }
+    });
+  }
+  
   template<typename Os>
   void write_array_value(Os *&os, const value::Array::value_type &v, utils::Color c = utils::Color::no_color)
   {
@@ -53,7 +82,7 @@ namespace czh::writer
             [&os, &c](auto &&i) { *os << utils::to_czhstr(i, c); },
             [](value::Reference i) { error::czh_unreachable(); },
         },
-        v.get_variant());
+        value::details::stored(v));
   }
   
   template<typename Os>
@@ -155,7 +184,7 @@ namespace czh::writer
               [this](auto &&i) { *os << utils::to_czhstr(i); },
               [](value::Reference i) { error::czh_unreachable(); },
           },
-          v.get_variant());
+          value::details::stored(v));
       *os << "\n";
     }
     
@@ -235,7 +264,7 @@ namespace czh::writer
               [this](auto &&i) { *os << utils::to_czhstr(i, utils::Color::with_color); },
               [](value::Reference) { error::czh_unreachable(); },
           },
-          v.get_variant());
+          value::details::stored(v));
       *os << "\n";
     }
     
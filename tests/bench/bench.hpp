@@ -0,0 +1,65 @@
+//   Copyright 2021-2023 libczh - caozhanhao
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+#ifndef LIBCZH_BENCH_HPP
+#define LIBCZH_BENCH_HPP
+#pragma once
+
+// The benchmarks are built with the tests, but are not run by ctest. Build them with
+// -DCMAKE_BUILD_TYPE=Release and run them from the build directory, e.g.
+//   ./tests/bench_lexer
+#include "libczh/czh.hpp"
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <string_view>
+
+namespace czh::bench
+{
+  using clock = std::chrono::steady_clock;
+
+  // Calls f repeatedly for at least `min_seconds`, and returns the seconds per call.
+  template<typename F>
+  double measure(F &&f, double min_seconds = 0.5)
+  {
+    f();// warm-up
+    std::size_t calls = 0;
+    auto beg = clock::now();
+    double elapsed = 0;
+    for (std::size_t batch = 1; elapsed < min_seconds; batch *= 2)
+    {
+      for (std::size_t i = 0; i < batch; ++i) f();
+      calls += batch;
+      elapsed = std::chrono::duration<double>(clock::now() - beg).count();
+    }
+    return elapsed / static_cast<double>(calls);
+  }
+
+  // Keeps `v` from being optimized away.
+  template<typename T>
+  void keep(const T &v)
+  {
+    asm volatile("" : : "r,m"(v) : "memory");
+  }
+
+  void print_header(std::string_view title)
+  {
+    std::printf("\n%s\n", std::string(title).c_str());
+  }
+
+  void print_row(std::string_view name, double value, std::string_view unit)
+  {
+    std::printf("  %-40s %12.2f %s\n", std::string(name).c_str(), value, std::string(unit).c_str());
+  }
+}
+#endif
@@ -0,0 +1,141 @@
+//   Copyright 2021-2023 libczh - caozhanhao
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+// Loading a config into structs with Czh::parse<T>(), and with parse() followed by
+// bind::from_node() or by get<T>() on each field.
+// Usage: bench_bind
+#include "bench.hpp"
+#include <optional>
+#include <vector>
+
+using namespace czh;
+
+namespace bench_config
+{
+  struct Tls
+  {
+    bool enabled;
+    std::string cert;
+    std::string key;
+  };
+  LIBCZH_BIND(Tls, enabled, cert, key)
+
+  struct Server
+  {
+    std::string host;
+    int port;
+    int workers;
+    double timeout;
+    std::vector<int> backlog;
+    Tls tls;
+  };
+  LIBCZH_BIND(Server, host, port, workers, timeout, backlog, tls)
+
+  struct Log
+  {
+    std::string path;
+    int level;
+    std::optional<bool> color;
+  };
+  LIBCZH_BIND(Log, path, level, color)
+
+  struct Config
+  {
+    Server server;
+    Log log;
+    std::string name;
+  };
+  LIBCZH_BIND(Config, server, log, name)
+}
+
+namespace
+{
+  using bench_config::Config;
+
+  const std::string bound = "server:\n"
+                            "  host = \"localhost\";\n"
+                            "  port = 8080;\n"
+                            "  workers = 16;\n"
+                            "  timeout = 2.5;\n"
+                            "  backlog = {128, 256, 512};\n"
+                            "  tls:\n"
+                            "    enabled = true;\n"
+                            "    cert = \"/etc/cert.pem\";\n"
+                            "    key = \"/etc/key.pem\";\n"
+                            "  end;\n"
+                            "end;\n"
+                            "log:\n"
+                            "  path = \"/var/log/app.log\";\n"
+                            "  level = 3;\n"
+                            "end;\n"
+                            "name = \"bench\";\n";
+
+  // The bound config, and a large block which no field is bound to.
+  std::string with_unknown()
+  {
+    std::string ret = bound + "unknown:\n";
+    for (int i = 0; i < 500; ++i)
+    {
+      ret += "  k" + std::to_string(i) + " = {" + std::to_string(i) + ", \"v\", 1.5};\n";
+    }
+    return ret + "end;\n";
+  }
+
+  Config by_hand(const Node &node)
+  {
+    Config c;
+    auto &s = node["server"];
+    c.server.host = s["host"].get<std::string>();
+    c.server.port = s["port"].get<int>();
+    c.server.workers = s["workers"].get<int>();
+    c.server.timeout = s["timeout"].get<double>();
+    c.server.backlog = s["backlog"].get<std::vector<int>>();
+    c.server.tls.enabled = s["tls"]["enabled"].get<bool>();
+    c.server.tls.cert = s["tls"]["cert"].get<std::string>();
+    c.server.tls.key = s["tls"]["key"].get<std::string>();
+    c.log.path = node["log"]["path"].get<std::string>();
+    c.log.level = node["log"]["level"].get<int>();
+    if (node["log"].has_node("color")) c.log.color = node["log"]["color"].get<bool>();
+    c.name = node["name"].get<std::string>();
+    return c;
+  }
+}
+
+int main()
+{
+  for (auto [name, code]: std::vector<std::pair<std::string, std::string>>{
+      {"bound fields only", bound}, {"with 500 unknown keys", with_unknown()}})
+  {
+    bench::print_header(name + ", " + std::to_string(code.size()) + " bytes, us per load");
+    auto direct = bench::measure([&code]
+                                 {
+                                   bench::keep(Czh(code, InputMode::string).parse<Config>().server.port);
+                                 });
+    auto from_node = bench::measure([&code]
+                                    {
+                                      auto node = Czh(code, InputMode::string).parse();
+                                      bench::keep(bind::from_node<Config>(node).server.port);
+                                    });
+    auto manual = bench::measure([&code]
+                                 {
+                                   auto node = Czh(code, InputMode::string).parse();
+                                   bench::keep(by_hand(node).server.port);
+                                 });
+    bench::print_row("Czh::parse<Config>()", direct * 1e6, "us");
+    bench::print_row("Czh::parse() + bind::from_node()", from_node * 1e6, "us");
+    bench::print_row("Czh::parse() + get<T>() on each field", manual * 1e6, "us");
+    bench::print_row("speedup over from_node()", from_node / direct, "x");
+  }
+  return 0;
+}
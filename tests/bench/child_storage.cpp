@@ -0,0 +1,228 @@
+//   Copyright 2021-2023 libczh - caozhanhao
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+// Inserting, looking up and iterating children of wide, small and deep trees, with the
+// flat child storage of Node and with the std::list + std::map storage it replaced.
+// Usage: bench_child_storage
+#include "bench.hpp"
+#include <algorithm>
+#include <list>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace czh;
+
+namespace
+{
+  // The storage before the flat one: children in a std::list, indexed by a std::map.
+  class ListNode
+  {
+  public:
+    std::string name;
+    ListNode *parent;
+    int value;
+    std::list<ListNode> nodes;
+    std::map<std::string, std::list<ListNode>::iterator> index;
+  public:
+    ListNode(std::string name_, ListNode *parent_, int value_)
+        : name(std::move(name_)), parent(parent_), value(value_) {}
+
+    ListNode &add(const std::string &n, int v)
+    {
+      nodes.emplace_back(n, this, v);
+      index.emplace(n, std::prev(nodes.end()));
+      return nodes.back();
+    }
+
+    ListNode *find(const std::string &n)
+    {
+      auto it = index.find(n);
+      return it == index.end() ? nullptr : &*it->second;
+    }
+  };
+
+  std::vector<std::string> names(std::size_t n)
+  {
+    std::vector<std::string> ret;
+    for (std::size_t i = 0; i < n; ++i) ret.emplace_back("key_" + std::to_string(i));
+    return ret;
+  }
+
+  std::vector<std::string> shuffled(std::vector<std::string> v)
+  {
+    std::shuffle(v.begin(), v.end(), std::mt19937(42));
+    return v;
+  }
+
+  long long sum(const Node &n)
+  {
+    long long ret = 0;
+    for (auto it = n.cbegin(); it != n.cend(); ++it) ret += it->is_node() ? sum(*it) : it->get_unchecked<int>();
+    return ret;
+  }
+
+  long long sum(const ListNode &n)
+  {
+    long long ret = n.value;
+    for (auto &r: n.nodes) ret += sum(r);
+    return ret;
+  }
+
+  void print(const std::string &name, double flat, double list, std::size_t ops)
+  {
+    auto n = static_cast<double>(ops);
+    bench::print_row(name + ", flat", flat / n * 1e9, "ns");
+    bench::print_row(name + ", std::list + std::map", list / n * 1e9, "ns");
+  }
+
+  void wide(std::size_t width)
+  {
+    bench::print_header("one block of " + std::to_string(width) + " children, ns per child");
+    auto keys = names(width);
+    auto order = shuffled(keys);
+    print("insert",
+          bench::measure([&keys]
+                         {
+                           Node root;
+                           auto &block = root.add_node("block");
+                           for (std::size_t i = 0; i < keys.size(); ++i) block.add(keys[i], static_cast<int>(i));
+                           bench::keep(root);
+                         }),
+          bench::measure([&keys]
+                         {
+                           ListNode root("", nullptr, 0);
+                           for (std::size_t i = 0; i < keys.size(); ++i) root.add(keys[i], static_cast<int>(i));
+                           bench::keep(root);
+                         }), width);
+
+    Node root;
+    auto &block = root.add_node("block");
+    ListNode list_root("", nullptr, 0);
+    for (std::size_t i = 0; i < keys.size(); ++i)
+    {
+      block.add(keys[i], static_cast<int>(i));
+      list_root.add(keys[i], static_cast<int>(i));
+    }
+    print("lookup",
+          bench::measure([&]
+                         {
+                           long long s = 0;
+                           for (auto &k: order) s += block.find(k)->get_unchecked<int>();
+                           bench::keep(s);
+                         }),
+          bench::measure([&]
+                         {
+                           long long s = 0;
+                           for (auto &k: order) s += list_root.find(k)->value;
+                           bench::keep(s);
+                         }), width);
+    print("iterate",
+          bench::measure([&] { bench::keep(sum(block)); }),
+          bench::measure([&] { bench::keep(sum(list_root)); }), width);
+  }
+
+  // Many blocks which are small enough to be scanned instead of indexed.
+  void small(std::size_t blocks, std::size_t width)
+  {
+    bench::print_header(std::to_string(blocks) + " blocks of " + std::to_string(width)
+                        + " children, ns per lookup");
+    auto keys = names(width);
+    auto order = shuffled(keys);
+    Node root;
+    ListNode list_root("", nullptr, 0);
+    std::vector<Node *> nodes;
+    std::vector<ListNode *> list_nodes;
+    for (std::size_t b = 0; b < blocks; ++b)
+    {
+      auto &n = root.add_node("b" + std::to_string(b));
+      auto &l = list_root.add("b" + std::to_string(b), 0);
+      for (std::size_t i = 0; i < width; ++i)
+      {
+        n.add(keys[i], static_cast<int>(i));
+        l.add(keys[i], static_cast<int>(i));
+      }
+      nodes.emplace_back(&n);
+      list_nodes.emplace_back(&l);
+    }
+    print("lookup",
+          bench::measure([&]
+                         {
+                           long long s = 0;
+                           for (auto n: nodes) for (auto &k: order) s += n->find(k)->get_unchecked<int>();
+                           bench::keep(s);
+                         }),
+          bench::measure([&]
+                         {
+                           long long s = 0;
+                           for (auto n: list_nodes) for (auto &k: order) s += n->find(k)->value;
+                           bench::keep(s);
+                         }), blocks * width);
+  }
+
+  // A chain of blocks, each with a few values beside the next block.
+  void deep(std::size_t depth)
+  {
+    bench::print_header("a chain of " + std::to_string(depth) + " blocks, ns per level");
+    auto keys = names(4);
+    Node root;
+    ListNode list_root("", nullptr, 0);
+    Node *n = &root;
+    ListNode *l = &list_root;
+    for (std::size_t d = 0; d < depth; ++d)
+    {
+      for (std::size_t i = 0; i < keys.size(); ++i)
+      {
+        n->add(keys[i], static_cast<int>(i));
+        l->add(keys[i], static_cast<int>(i));
+      }
+      n = &n->add_node("next");
+      l = &l->add("next", 0);
+    }
+    print("walk down by name",
+          bench::measure([&]
+                         {
+                           const Node *p = &root;
+                           long long s = 0;
+                           while (auto next = p->find("next"))
+                           {
+                             s += p->find("key_3")->get_unchecked<int>();
+                             p = next;
+                           }
+                           bench::keep(s);
+                         }),
+          bench::measure([&]
+                         {
+                           ListNode *p = &list_root;
+                           long long s = 0;
+                           while (auto next = p->find("next"))
+                           {
+                             s += p->find("key_3")->value;
+                             p = next;
+                           }
+                           bench::keep(s);
+                         }), depth);
+    print("iterate",
+          bench::measure([&] { bench::keep(sum(root)); }),
+          bench::measure([&] { bench::keep(sum(list_root)); }), depth);
+  }
+}
+
+int main()
+{
+  wide(100000);
+  small(10000, 6);
+  deep(2000);
+  return 0;
+}
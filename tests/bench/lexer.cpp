@@ -0,0 +1,101 @@
+//   Copyright 2021-2023 libczh - caozhanhao
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+// Lexing throughput with the structural index and one character at a time, on inputs
+// of about 4 MB with different shapes.
+// Usage: bench_lexer
+#include "bench.hpp"
+#include <memory>
+#include <vector>
+
+using namespace czh;
+
+namespace
+{
+  constexpr std::size_t target_size = 4 << 20;
+
+  std::string repeat(const std::string &block)
+  {
+    std::string ret;
+    ret.reserve(target_size + block.size() * 2);
+    for (int i = 0; ret.size() < target_size; ++i)
+    {
+      ret += "b" + std::to_string(i) + ":\n" + block + "end;\n";
+    }
+    return ret;
+  }
+
+  std::string mixed()
+  {
+    return repeat("  int = 42;\n"
+                  "  double = -6e-2;\n"
+                  "  bool = true;\n"
+                  "  name = \"a string value\";\n"
+                  "  ints = {1, 2, 3, 4, 5};\n"
+                  "  any = {false, 1.5, \"2\", 3};\n"
+                  "  inner:\n"
+                  "    port = 8080; <the port>\n"
+                  "    host = \"localhost\";\n"
+                  "  end;\n"
+                  "  ref = inner::port;\n");
+  }
+
+  std::string strings()
+  {
+    std::string s(200, 'x');
+    for (std::size_t i = 0; i < s.size(); i += 20) s[i] = ' ';
+    return repeat("  a = \"" + s + "\";\n"
+                  "  b = \"escaped \\\"quotes\\\" and \\\\ backslashes " + s + "\";\n");
+  }
+
+  std::string blanks()
+  {
+    return repeat("                                  a = 1;\n"
+                  "  <" + std::string(300, 'n') + ">\n"
+                  "\n\n\t\t\t\t\t\t\t\t  b = 2;  <a note>    <another note>\n");
+  }
+
+  std::size_t lex(const std::shared_ptr<const std::string> &code, bool indexed)
+  {
+    lexer::Lexer lex;
+    lex.set_indexed(indexed);
+    lex.set_czh("bench", code, 0, code->size());
+    std::size_t tokens = 0;
+    while (lex.get().type != token::TokenType::FEND) ++tokens;
+    return tokens;
+  }
+}
+
+int main()
+{
+  for (auto [name, text]: std::vector<std::pair<std::string, std::string>>{
+      {"mixed config", mixed()}, {"long strings", strings()}, {"blanks and notes", blanks()}})
+  {
+    auto code = std::make_shared<const std::string>(std::move(text));
+    auto mb = static_cast<double>(code->size()) / (1 << 20);
+    bench::print_header(name + ", " + std::to_string(code->size() >> 10) + " KB, "
+                        + std::to_string(lex(code, true)) + " tokens, MB/s");
+    if (lex(code, true) != lex(code, false))
+    {
+      std::printf("  the two lexers give different numbers of tokens\n");
+      return 1;
+    }
+    auto indexed = mb / bench::measure([&code] { bench::keep(lex(code, true)); });
+    auto scalar = mb / bench::measure([&code] { bench::keep(lex(code, false)); });
+    bench::print_row("structural index", indexed, "MB/s");
+    bench::print_row("one character at a time", scalar, "MB/s");
+    bench::print_row("speedup", indexed / scalar, "x");
+  }
+  return 0;
+}
@@ -0,0 +1,96 @@
+//   Copyright 2021-2023 libczh - caozhanhao
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+// Parsing many small payloads with a new Czh each, and with one ParseContext. Counts the
+// calls to operator new per payload.
+// Usage: bench_parse_context
+#include "bench.hpp"
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+namespace
+{
+  std::atomic<std::size_t> allocations = 0;
+}
+
+void *operator new(std::size_t n)
+{
+  allocations.fetch_add(1, std::memory_order_relaxed);
+  if (auto p = std::malloc(n == 0 ? 1 : n)) return p;
+  throw std::bad_alloc();
+}
+
+void operator delete(void *p) noexcept { std::free(p); }
+
+void operator delete(void *p, std::size_t) noexcept { std::free(p); }
+
+using namespace czh;
+
+namespace
+{
+  std::vector<std::string> payloads(std::size_t n)
+  {
+    std::vector<std::string> ret;
+    for (std::size_t i = 0; i < n; ++i)
+    {
+      auto id = std::to_string(i);
+      ret.emplace_back("request:\n"
+                       "  id = " + id + ";\n"
+                       "  user = \"user" + id + "\";\n"
+                       "  scopes = {\"read\", \"write\"};\n"
+                       "  limits: rate = " + id + "; burst = 10; end;\n"
+                       "end;\n"
+                       "trace = " + std::string(i % 2 == 0 ? "true" : "false") + ";\n");
+    }
+    return ret;
+  }
+
+  // Parses each payload once, and returns the seconds and the allocations per payload.
+  template<typename F>
+  std::pair<double, double> run(const std::vector<std::string> &docs, F &&parse)
+  {
+    for (auto &d: docs) parse(d);// warm-up
+    auto before = allocations.load();
+    auto beg = bench::clock::now();
+    for (auto &d: docs) parse(d);
+    auto seconds = std::chrono::duration<double>(bench::clock::now() - beg).count();
+    auto n = static_cast<double>(docs.size());
+    return {seconds / n, static_cast<double>(allocations.load() - before) / n};
+  }
+}
+
+int main()
+{
+  auto docs = payloads(20000);
+  bench::print_header(std::to_string(docs.size()) + " payloads of about " + std::to_string(docs[0].size())
+                      + " bytes");
+  auto [fresh_time, fresh_allocs] = run(docs, [](const std::string &d)
+  {
+    auto node = Czh(d, InputMode::string).parse();
+    bench::keep(node["request"]["limits"]["rate"].get<int>());
+  });
+  ParseContext ctx;
+  auto [ctx_time, ctx_allocs] = run(docs, [&ctx](const std::string &d)
+  {
+    auto &node = ctx.parse(d);
+    bench::keep(node["request"]["limits"]["rate"].get<int>());
+  });
+  bench::print_row("new Czh for each payload", fresh_time * 1e6, "us per payload");
+  bench::print_row("ParseContext", ctx_time * 1e6, "us per payload");
+  bench::print_row("new Czh for each payload", fresh_allocs, "allocations per payload");
+  bench::print_row("ParseContext", ctx_allocs, "allocations per payload");
+  return 0;
+}
@@ -0,0 +1,124 @@
+//   Copyright 2021-2023 libczh - caozhanhao
+//
+//   Licensed under the Apache License, Version 2.0 (the "License");
+//   you may not use this file except in compliance with the License.
+//   You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+//   Unless required by applicable law or agreed to in writing, software
+//   distributed under the License is distributed on an "AS IS" BASIS,
+//   WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+//   See the License for the specific language governing permissions and
+//   limitations under the License.
+
+// Read throughput of SharedConfig and of a Snapshot behind a std::shared_mutex, by the
+// number of reader threads, while a writer publishes a new version every millisecond.
+// Usage: bench_shared_config [max threads]
+#include "bench.hpp"
+#include <atomic>
+#include <shared_mutex>
+#include <thread>
+#include <vector>
+
+using namespace czh;
+
+namespace
+{
+  constexpr auto duration = std::chrono::milliseconds(500);
+
+  // Runs `threads` readers and one writer for `duration`, and returns the reads per second.
+  template<typename Read, typename Write>
+  double run(std::size_t threads, Read &&read, Write &&write)
+  {
+    std::atomic<bool> start = false;
+    std::atomic<bool> done = false;
+    std::atomic<std::size_t> total = 0;
+    std::vector<std::thread> readers;
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+      readers.emplace_back([&]
+                           {
+                             auto reader = read();
+                             std::size_t count = 0;
+                             long long sum = 0;
+                             while (!start.load()) std::this_thread::yield();
+                             while (!done.load(std::memory_order_relaxed))
+                             {
+                               for (int j = 0; j < 256; ++j) sum += reader();
+                               count += 256;
+                             }
+                             bench::keep(sum);
+                             total += count;
+                           });
+    }
+    std::thread writer([&]
+                       {
+                         while (!start.load()) std::this_thread::yield();
+                         for (int i = 0; !done.load(); ++i)
+                         {
+                           write(i);
+                           std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                         }
+                       });
+    auto beg = bench::clock::now();
+    start = true;
+    std::this_thread::sleep_for(duration);
+    done = true;
+    for (auto &r: readers) r.join();
+    writer.join();
+    auto seconds = std::chrono::duration<double>(bench::clock::now() - beg).count();
+    return static_cast<double>(total.load()) / seconds;
+  }
+}
+
+int main(int argc, char **argv)
+{
+  std::size_t max_threads = argc > 1 ? std::stoul(argv[1]) : std::thread::hardware_concurrency();
+  if (max_threads == 0) max_threads = 1;
+  std::string code = "server:";
+  for (int i = 0; i < 32; ++i) code += " k" + std::to_string(i) + " = " + std::to_string(i) + ";";
+  Snapshot initial(Czh(code + " end;", InputMode::string).parse());
+  const std::vector<std::string> path{"server", "k17"};
+  std::printf("reader threads: 1 to %zu, on %u hardware threads\n", max_threads, std::thread::hardware_concurrency());
+
+  for (std::size_t threads = 1; threads <= max_threads; threads *= 2)
+  {
+    bench::print_header(std::to_string(threads) + " reader thread(s), M reads/s in total");
+
+    SharedConfig config(initial);
+    auto lock_free = run(threads,
+                         [&]
+                         {
+                           return [&path, reader = config.reader()]
+                           {
+                             auto version = reader.read();
+                             return version->get<int>(path);
+                           };
+                         },
+                         [&](int i) { config.update([i](Snapshot &next) { next.set({"server", "k0"}, i); }); });
+    bench::print_row("SharedConfig", lock_free / 1e6, "M/s");
+
+    Snapshot locked_config = initial;
+    std::shared_mutex mutex;
+    auto locked = run(threads,
+                      [&]
+                      {
+                        return [&]
+                        {
+                          std::shared_lock lock(mutex);
+                          return locked_config.get<int>(path);
+                        };
+                      },
+                      [&](int i)
+                      {
+                        auto next = locked_config;
+                        next.set({"server", "k0"}, i);
+                        std::unique_lock lock(mutex);
+                        locked_config = std::move(next);
+                      });
+    bench::print_row("Snapshot behind std::shared_mutex", locked / 1e6, "M/s");
+    if (threads < max_threads && threads * 2 > max_threads) threads = max_threads / 2;
+  }
+  return 0;
+}
@@ -68,6 +68,22 @@ namespace czh::test
     IteratorTest end() const { return IteratorTest{b}; }
   };
   
+  struct BindInner
+  {
+    int a;
+    std::string s;
+  };
+  LIBCZH_BIND(BindInner, a, s)
+  
+  struct BindOuter
+  {
+    BindInner inner;
+    std::vector<int> arr;
+    double d;
+    std::optional<bool> flag;
+  };
+  LIBCZH_BIND(BindOuter, inner, arr, d, flag)
+  
   
   LIBCZH_TEST(czh)
   {
@@ -147,4 +163,856 @@ namespace czh::test
         }
     }), ("a=1;node:abc=123;end;"_czh));
   }
+  
+  LIBCZH_TEST(parallel)
+  {
+    std::string str = R"(
+<note: end>
+a:
+  v = 1
+  s = "end: <"
+  b: c = 2; end
+end;
+x = 3
+d <end:>:
+  r = ::a::b::c
+  arr = {1, 2, 3}
+end
+e:
+  r = ::d::r
+end
+)";
+    Czh sequential(str, InputMode::string);
+    Czh parallel(str, InputMode::string);
+    auto seq = sequential.parse();
+    auto par = parallel.parse_parallel(4);
+    LIBCZH_EXPECT_EQ(seq, par);
+    LIBCZH_EXPECT_EQ(par["e"]["r"].get<int>(), 2);
+    LIBCZH_EXPECT_EQ(par["a"]["s"].get<std::string>(), "end: <");
+    LIBCZH_EXPECT_EQ(lexer::split_top_level(str, 0, str.size(), 4).size(), 3u);
+  }
+  
+  LIBCZH_TEST(structural_index)
+  {
+    std::string str = std::string(60, ' ') + R"(<a "<b>"> x = "\\\"<";)";
+    lexer::StructuralIndex index;
+    index.build(str.data(), str.size());
+    LIBCZH_EXPECT_EQ(index.next_significant(0), str.find('x'));
+    LIBCZH_EXPECT_EQ(index.next_quote(str.find('=')), str.find('"', str.find('=')));
+    LIBCZH_EXPECT_EQ(index.next_quote(str.find('=') + 3), str.rfind('"'));
+    LIBCZH_EXPECT_EQ(index.unclosed_note_pos(), lexer::StructuralIndex::npos);
+    std::string words = "name_1 = -1.5e3;b:end";
+    index.build(words.data(), words.size());
+    LIBCZH_EXPECT_EQ(index.next_delimiter(0), words.find(' '));
+    LIBCZH_EXPECT_EQ(index.next_delimiter(words.find('-')), words.find(';'));
+    LIBCZH_EXPECT_EQ(index.next_delimiter(words.find(':') + 1), words.size());
+    std::string unclosed = "a = 1; <x <y> z";
+    index.build(unclosed.data(), unclosed.size());
+    LIBCZH_EXPECT_EQ(index.unclosed_note_pos(), unclosed.find('<'));
+    try
+    {
+      czh::Czh(unclosed, czh::InputMode::string).parse();
+      LIBCZH_EXPECT_TRUE(false);
+    }
+    catch (czh::error::CzhError &e)
+    {
+      LIBCZH_EXPECT_TRUE(std::string(e.what()).find("Expected '>'") != std::string::npos);
+    }
+    LIBCZH_EXPECT_EQ("n_\xC3\xA9 = -1.5e3;"_czh["n_\xC3\xA9"].get<double>(), -1500.0);
+    using namespace czh::literals;
+    LIBCZH_EXPECT_EQ("s = \"\\\\a\\\"b\" <c\"d>;"_czh["s"].get<std::string>(), "\\a\"b");
+  }
+  
+  LIBCZH_TEST(tape)
+  {
+    czh::Czh node_czh("../../tests/czh/inputtest.czh", czh::InputMode::file);
+    czh::Czh tape_czh("../../tests/czh/inputtest.czh", czh::InputMode::file);
+    auto node = node_czh.parse();
+    auto tape = tape_czh.parse_tape();
+    auto root = tape.root();
+    LIBCZH_EXPECT_EQ(root["czh"]["block"]["a"].get<int>(), 200000000);
+    LIBCZH_EXPECT_EQ(root["czh"]["block"]["b"].get<int>(), 0);
+    LIBCZH_EXPECT_EQ(root["czh"]["block"]["d"].get<int>(), 200000000);
+    LIBCZH_EXPECT_TRUE(root["czh"]["block"]["d"].is<value::Reference>());
+    LIBCZH_EXPECT_EQ(root["czh"]["dt6"].get<double>(), 1.7976931348623157e308);
+    LIBCZH_EXPECT_EQ(root["czh"]["long_long"].get<long long>(), 200000000000);
+    LIBCZH_EXPECT_EQ(root["czh"]["\xF0\x9F\x98\x80UTF\xE7\xA4\xBA\xE4\xBE\x8B"].get<std::string>(),
+                     node["czh"]["\xF0\x9F\x98\x80UTF\xE7\xA4\xBA\xE4\xBE\x8B"].get<std::string>());
+    LIBCZH_EXPECT_TRUE(root["czh"]["int_array"].get<std::vector<int>>() == (std::vector<int>{-600, 2, -9000}));
+    LIBCZH_EXPECT_TRUE(root["czh"]["any_array"].get_value() == node["czh"]["any_array"].get_value());
+    auto it = node["czh"].begin();
+    for (auto r: root["czh"])
+    {
+      LIBCZH_EXPECT_EQ(std::string(r.get_name()), it->get_name());
+      LIBCZH_EXPECT_EQ(r.is_node(), it->is_node());
+      ++it;
+    }
+    LIBCZH_EXPECT_TRUE(it == node["czh"].end());
+  }
+  
+  LIBCZH_TEST(bind)
+  {
+    std::string code = "inner: a = 1; skip: x = a; y: end; end; s = \"s\"; end;"
+                       "arr = {1, 2, 3}; d = 0.5; z = {\"z\"};";
+    auto direct = czh::Czh(code, czh::InputMode::string).parse<BindOuter>();
+    auto node = czh::Czh(code, czh::InputMode::string).parse();
+    auto from_node = czh::bind::from_node<BindOuter>(node);
+    for (auto &b: {direct, from_node})
+    {
+      LIBCZH_EXPECT_EQ(b.inner.a, 1);
+      LIBCZH_EXPECT_EQ(b.inner.s, "s");
+      LIBCZH_EXPECT_TRUE(b.arr == (std::vector<int>{1, 2, 3}));
+      LIBCZH_EXPECT_EQ(b.d, 0.5);
+      LIBCZH_EXPECT_FALSE(b.flag.has_value());
+    }
+    bool missing = false;
+    try
+    {
+      czh::Czh("inner: a = 1; end; d = 0.5;", czh::InputMode::string).parse<BindOuter>();
+    }
+    catch (czh::error::CzhError &)
+    {
+      missing = true;
+    }
+    LIBCZH_EXPECT_TRUE(missing);
+  }
+  
+  LIBCZH_TEST(schema)
+  {
+    czh::schema::Schema schema;
+    schema.value<int>("server::port").range(1, 65535)
+        .value<std::string>("server::host")
+        .value<std::vector<int>>("server::ids")
+        .value<bool>("server::debug").optional()
+        .node("server").closed();
+    auto check = [&schema](const std::string &code)
+    {
+      try
+      {
+        czh::Czh(code, czh::InputMode::string).set_schema(schema).parse();
+      }
+      catch (czh::error::CzhError &)
+      {
+        return false;
+      }
+      return true;
+    };
+    LIBCZH_EXPECT_TRUE(check("server: port = 80; host = \"h\"; ids = {1, 2}; end; other = 1;"));
+    LIBCZH_EXPECT_TRUE(check("server: port = 80; host = \"h\"; ids = {}; debug = true;"));
+    LIBCZH_EXPECT_FALSE(check("server: port = 0; host = \"h\"; ids = {1}; end;"));
+    LIBCZH_EXPECT_FALSE(check("server: port = 80; host = 1; ids = {1}; end;"));
+    LIBCZH_EXPECT_FALSE(check("server: port = 80; host = \"h\"; ids = {1, \"2\"}; end;"));
+    LIBCZH_EXPECT_FALSE(check("server: port = 80; ids = {1}; end;"));
+    LIBCZH_EXPECT_FALSE(check("server: port = 80; host = \"h\"; ids = {1}; x = 1; end;"));
+    LIBCZH_EXPECT_FALSE(check("other = 1;"));
+    try
+    {
+      czh::Czh("other = 1; o: x = 1; end;", czh::InputMode::string).set_schema(schema).parse_parallel(2);
+      LIBCZH_EXPECT_TRUE(false);
+    }
+    catch (czh::error::CzhError &e)
+    {
+      LIBCZH_EXPECT_TRUE(std::string(e.what()).find("Missing required node 'server'") != std::string::npos);
+    }
+  }
+  
+  LIBCZH_TEST(packed_array)
+  {
+    auto node = czh::Czh("i = {1, 2, 3}; s = {\"a\", \"b\"}; m = {1, \"a\"}; e = {};", czh::InputMode::string).parse();
+    LIBCZH_EXPECT_TRUE(node["i"].is<value::Array>());
+    LIBCZH_EXPECT_TRUE(node["i"].get<std::vector<int>>() == (std::vector<int>{1, 2, 3}));
+    LIBCZH_EXPECT_TRUE(node["i"].get<std::list<int>>() == (std::list<int>{1, 2, 3}));
+    LIBCZH_EXPECT_TRUE(node["i"].get<value::Array>() == (value::Array{1, 2, 3}));
+    LIBCZH_EXPECT_TRUE(node["s"].get<std::vector<std::string>>() == (std::vector<std::string>{"a", "b"}));
+    LIBCZH_EXPECT_TRUE(node["m"].get<value::Array>() == (value::Array{1, "a"}));
+    LIBCZH_EXPECT_TRUE(node["e"].get<std::vector<double>>().empty());
+    LIBCZH_EXPECT_TRUE(node["i"].get_value() == value::Value(value::Array{1, 2, 3}));
+    // Packing is not seen from get_variant().
+    auto variant = node["i"].get_value().get_variant();
+    static_assert(std::variant_size_v<decltype(variant)> == 8);
+    LIBCZH_EXPECT_TRUE(std::get<value::Array>(variant) == (value::Array{1, 2, 3}));
+    LIBCZH_EXPECT_FALSE(node["i"].get_value() == value::Value(std::vector<long long>{1, 2, 3}));
+    node["e"] = std::vector<int>{4, 5};
+    std::ostringstream os;
+    os << node;
+    LIBCZH_EXPECT_EQ(os.str(), "i={1,2,3};s={\"a\",\"b\"};m={1,\"a\"};e={4,5};");
+  }
+  
+  LIBCZH_TEST(link)
+  {
+    auto node = czh::Czh("a = 1; x: y = 2; end; b: x: end; r = a; p = x::y; end;", czh::InputMode::string).parse();
+    LIBCZH_EXPECT_EQ(node["b"]["r"].get<int>(), 1);
+    LIBCZH_EXPECT_EQ(node["b"]["p"].get<int>(), 2);
+    node["b"].remove();
+    node.add_node("b").add("a", 3);
+    node["b"].add("r", value::Reference({"a"}));
+    LIBCZH_EXPECT_EQ(node["b"]["r"].get<int>(), 3);
+    node.link();
+    LIBCZH_EXPECT_EQ(node["b"]["r"].get<int>(), 3);
+    node["b"]["a"] = 4;
+    LIBCZH_EXPECT_EQ(node["b"]["r"].get<int>(), 4);
+    auto parse_error = [](const std::string &code)
+    {
+      try
+      {
+        czh::Czh(code, czh::InputMode::string).parse();
+      }
+      catch (czh::error::CzhError &)
+      {
+        return true;
+      }
+      return false;
+    };
+    LIBCZH_EXPECT_TRUE(parse_error("a = b; b = c; c = a;"));
+    LIBCZH_EXPECT_TRUE(parse_error("a = b;"));
+    LIBCZH_EXPECT_FALSE(parse_error("a = b; b = c; c = 1;"));
+  }
+  
+  LIBCZH_TEST(reparse)
+  {
+    std::string code = "a = 1;\nb:\n  c = 2;\n  d:\n    e = 3;\n  end;\nend;\nf = b::d::e;\ng: h = 4; end;\n";
+    czh::Czh czh(code, czh::InputMode::string);
+    auto node = czh.parse();
+    auto pos = code.find("3");
+    auto &d = czh.reparse(node, {pos, pos + 1, "30; i = 5"});
+    LIBCZH_EXPECT_TRUE(&d == &node["b"]["d"]);
+    LIBCZH_EXPECT_EQ(node["b"]["d"]["e"].get<int>(), 30);
+    LIBCZH_EXPECT_EQ(node["b"]["d"]["i"].get<int>(), 5);
+    LIBCZH_EXPECT_EQ(node["f"].get<int>(), 30);
+    code.replace(pos, 1, "30; i = 5");
+    // The tokens after the edit are shifted.
+    pos = code.find("4");
+    czh.reparse(node, {pos, pos + 1, "40"});
+    LIBCZH_EXPECT_EQ(node["g"]["h"].get<int>(), 40);
+    code.replace(pos, 1, "40");
+    // The edit breaks "d", so "b" is reparsed.
+    pos = code.find("end;");
+    auto &b = czh.reparse(node, {pos, pos + 4, "end; j = 6;"});
+    LIBCZH_EXPECT_TRUE(&b == &node["b"]);
+    code.replace(pos, 4, "end; j = 6;");
+    // The tokens which were not visited are moved when they are reported.
+    auto lineno = std::count(code.begin(), code.begin() + static_cast<std::ptrdiff_t>(code.find("f =")), '\n') + 1;
+    LIBCZH_EXPECT_EQ(node["f"].get_token().pos.location(), "czh from std::string:line " + std::to_string(lineno));
+    // A failed reparse keeps the code.
+    bool error = false;
+    try
+    {
+      pos = code.find("40");
+      czh.reparse(node, {pos, pos + 2, "= ="});
+    }
+    catch (czh::error::CzhError &)
+    {
+      error = true;
+    }
+    LIBCZH_EXPECT_TRUE(error);
+    LIBCZH_EXPECT_EQ(node["f"].get_token().pos.location(), "czh from std::string:line " + std::to_string(lineno));
+    std::ostringstream expected, actual;
+    expected << czh::Czh(code, czh::InputMode::string).parse();
+    actual << node;
+    LIBCZH_EXPECT_EQ(actual.str(), expected.str());
+  }
+  
+  LIBCZH_TEST(parse_context)
+  {
+    czh::ParseContext ctx;
+    auto &a = ctx.parse("a = 1; b: c = \"a long string value\"; d = {1, 2}; end; e = b::c;");
+    LIBCZH_EXPECT_EQ(a["b"]["c"].get<std::string>(), "a long string value");
+    czh::Node copy(a);
+    auto &b = ctx.parse("x: y = 2; end; z = x::y;");
+    LIBCZH_EXPECT_FALSE(b.has_node("a"));
+    LIBCZH_EXPECT_EQ(b["z"].get<int>(), 2);
+    LIBCZH_EXPECT_EQ(copy["e"].get<std::string>(), "a long string value");
+    bool error = false;
+    try
+    {
+      ctx.parse("a = 1; a = 2;");
+    }
+    catch (czh::error::CzhError &)
+    {
+      error = true;
+    }
+    LIBCZH_EXPECT_TRUE(error);
+    auto &c = ctx.parse("a = 1; b: c = 3; end;");
+    LIBCZH_EXPECT_EQ(c["b"]["c"].get<int>(), 3);
+    std::ostringstream os;
+    os << c;
+    LIBCZH_EXPECT_EQ(os.str(), "a=1;b:c=3;end;");
+  }
+  
+  LIBCZH_TEST(child_storage)
+  {
+    czh::Node node;
+    auto &block = node.add_node("block");
+    auto &inner = block.add_node("inner").add_node("leaf");
+    for (int i = 0; i < 100; ++i)
+    {
+      block.add("v" + std::to_string(i), i);
+    }
+    block.add("before", -1, "v50");
+    LIBCZH_EXPECT_EQ(block["v99"].get<int>(), 99);
+    LIBCZH_EXPECT_EQ(block["before"].get<int>(), -1);
+    LIBCZH_EXPECT_EQ((block.begin() + 51)->get_name(), "before");
+    LIBCZH_EXPECT_EQ(block.crbegin()->get_name(), "v99");
+    LIBCZH_EXPECT_TRUE(inner.get_path() == (std::vector<std::string>{"leaf", "inner", "block"}));
+    block["v10"].remove();
+    block["v20"].rename("w20");
+    LIBCZH_EXPECT_FALSE(block.has_node("v10"));
+    LIBCZH_EXPECT_FALSE(block.has_node("v20"));
+    LIBCZH_EXPECT_EQ(block["w20"].get<int>(), 20);
+    LIBCZH_EXPECT_EQ(block["v21"].get<int>(), 21);
+    int sum = 0;
+    for (auto it = std::next(block.begin()); it != block.end(); ++it)
+    {
+      sum += it->get<int>();
+    }
+    LIBCZH_EXPECT_EQ(sum, 4950 - 10 - 1);
+    block.add("x", 1, "inner");
+    LIBCZH_EXPECT_EQ(block.begin()->get_name(), "x");
+    LIBCZH_EXPECT_TRUE(&block["inner"]["leaf"] == &inner);
+  }
+  
+  LIBCZH_TEST(document)
+  {
+    std::optional<czh::Node> copy;
+    {
+      auto doc = czh::Czh("a = 1; b: c = \"a long string value\"; d = {1, 2}; end; e = b::c;",
+                          czh::InputMode::string).parse_document();
+      LIBCZH_EXPECT_EQ((*doc)["e"].get<std::string>(), "a long string value");
+      auto moved = std::move(doc);
+      auto &root = *moved;
+      root["b"].add_node("f").add("g", 2);
+      LIBCZH_EXPECT_EQ(root["b"]["f"]["g"].get<int>(), 2);
+      copy.emplace(root["b"]);
+      std::ostringstream os;
+      os << root;
+      LIBCZH_EXPECT_EQ(os.str(), "a=1;b:c=\"a long string value\";d={1,2};f:g=2;end;end;e=b::c;");
+    }
+    LIBCZH_EXPECT_EQ((*copy)["f"]["g"].get<int>(), 2);
+  }
+  
+  LIBCZH_TEST(move_to)
+  {
+    auto node = czh::Czh("a: b: c = 1; end; d = 2; end; e: f = 3; end; r = a::b::c;", czh::InputMode::string).parse();
+    auto &b = node["a"]["b"];
+    auto &c = b["c"];
+    b.move_to(node["e"]);
+    LIBCZH_EXPECT_FALSE(node["a"].has_node("b"));
+    LIBCZH_EXPECT_TRUE(&node["e"]["b"] == &b);
+    LIBCZH_EXPECT_TRUE(&node["e"]["b"]["c"] == &c);
+    LIBCZH_EXPECT_TRUE(c.get_path() == (std::vector<std::string>{"c", "b", "e"}));
+    node["a"]["d"].move_to(node["e"], "f");
+    std::ostringstream os;
+    os << node["e"];
+    LIBCZH_EXPECT_EQ(os.str(), "e:d=2;f=3;b:c=1;end;end;");
+    auto error = [](auto &&f)
+    {
+      try
+      {
+        f();
+      }
+      catch (czh::error::CzhError &)
+      {
+        return true;
+      }
+      return false;
+    };
+    LIBCZH_EXPECT_TRUE(error([&node] { node["e"].move_to(node["e"]["b"]); }));
+    LIBCZH_EXPECT_TRUE(error([&node] { node["e"]["f"].move_to(node["e"], "x"); }));
+    node.add_node("a2").add("d", 4);
+    LIBCZH_EXPECT_TRUE(error([&node] { node["a2"]["d"].move_to(node["e"]); }));
+    auto doc = czh::Czh("x: y = 1; end;", czh::InputMode::string).parse_document();
+    auto &y = (*doc)["x"]["y"];
+    czh::Document moved;
+    moved = std::move(doc);
+    LIBCZH_EXPECT_TRUE(&(*moved)["x"]["y"] == &y);
+    czh::Node taken(std::move(node["e"]));
+    LIBCZH_EXPECT_TRUE(taken["b"].get_last_node() == &taken);
+    LIBCZH_EXPECT_TRUE(&taken["b"]["c"] == &c);
+  }
+  
+  LIBCZH_TEST(snapshot)
+  {
+    auto node = czh::Czh("a: b = 1; c: d = 2; end; end; e = a::c::d; f: g = 3; end;", czh::InputMode::string).parse();
+    czh::Snapshot live(node);
+    auto snap = live;
+    live.set({"a", "c", "d"}, 4).set({"a", "h"}, "x").remove({"f"}).add_node({"i"});
+    LIBCZH_EXPECT_EQ(snap.get<int>({"a", "c", "d"}), 2);
+    LIBCZH_EXPECT_EQ(snap.get<int>({"e"}), 2);
+    LIBCZH_EXPECT_TRUE(snap.contains({"f", "g"}));
+    LIBCZH_EXPECT_FALSE(snap.contains({"i"}));
+    LIBCZH_EXPECT_EQ(live.get<int>({"a", "c", "d"}), 4);
+    LIBCZH_EXPECT_EQ(live.get<int>({"e"}), 4);
+    LIBCZH_EXPECT_EQ(live.get<std::string>({"a", "h"}), "x");
+    LIBCZH_EXPECT_FALSE(live.contains({"f"}));
+    LIBCZH_EXPECT_TRUE(live.is_node({"i"}));
+    LIBCZH_EXPECT_TRUE(live.get_value({"e"}).is<czh::value::Reference>());
+    LIBCZH_EXPECT_TRUE(snap.to_node() == node);
+    LIBCZH_EXPECT_TRUE(live.names() == (std::vector<std::string>{"a", "e", "i"}));
+    live.set({"e"}, 5);
+    LIBCZH_EXPECT_EQ(snap.get<int>({"e"}), 2);
+    bool thrown = false;
+    try
+    {
+      live.set({"x", "y"}, 1);
+    }
+    catch (czh::error::Error &)
+    {
+      thrown = true;
+    }
+    LIBCZH_EXPECT_TRUE(thrown);
+  }
+  
+  LIBCZH_TEST(freeze)
+  {
+    auto node = czh::Czh("../../tests/czh/inputtest.czh", czh::InputMode::file).parse();
+    auto tape = czh::Czh("../../tests/czh/inputtest.czh", czh::InputMode::file).parse_tape();
+    auto frozen = czh::tape::freeze(node);
+    LIBCZH_EXPECT_EQ(frozen.size_in_bytes(), tape.size_in_bytes());
+    auto root = frozen.root();
+    LIBCZH_EXPECT_EQ(root["czh"]["block"]["d"].get<int>(), 200000000);
+    LIBCZH_EXPECT_TRUE(root["czh"]["block"]["d"].is<value::Reference>());
+    LIBCZH_EXPECT_TRUE(root["czh"]["int_array"].get<std::vector<int>>() == (std::vector<int>{-600, 2, -9000}));
+    LIBCZH_EXPECT_TRUE(root["czh"]["any_array"].get_value() == node["czh"]["any_array"].get_value());
+    czh::Node wide;
+    auto &w = wide.add_node("w");
+    for (int i = 0; i < 100; ++i)
+    {
+      w.add("k" + std::to_string(i), i);
+    }
+    wide.add("r", value::Reference({"k42", "w", ""}));
+    auto frozen_wide = czh::tape::freeze(wide);
+    for (int i = 0; i < 100; ++i)
+    {
+      LIBCZH_EXPECT_EQ(frozen_wide.root()["w"]["k" + std::to_string(i)].get<int>(), i);
+    }
+    LIBCZH_EXPECT_FALSE(frozen_wide.root()["w"].has_node("k100"));
+    LIBCZH_EXPECT_EQ(frozen_wide.root()["r"].get<int>(), 42);
+  }
+  
+  LIBCZH_TEST(shared_config)
+  {
+    czh::Snapshot initial;
+    initial.set({"a"}, 0).set({"b"}, 0);
+    czh::SharedConfig config(initial);
+    std::atomic<bool> done = false;
+    std::atomic<int> errors = 0;
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i)
+    {
+      readers.emplace_back([&config, &done, &errors]
+                           {
+                             auto reader = config.reader();
+                             int last = 0;
+                             while (!done.load())
+                             {
+                               auto version = reader.read();
+                               auto a = version->get<int>({"a"});
+                               if (a != version->get<int>({"b"}) || a < last) ++errors;
+                               last = a;
+                             }
+                           });
+    }
+    for (int i = 1; i <= 1000; ++i)
+    {
+      config.update([i](czh::Snapshot &next) { next.set({"a"}, i).set({"b"}, i); });
+    }
+    done = true;
+    for (auto &r: readers) r.join();
+    LIBCZH_EXPECT_EQ(errors.load(), 0);
+    auto reader = config.reader();
+    LIBCZH_EXPECT_EQ(reader.read()->get<int>({"a"}), 1000);
+  }
+  
+  LIBCZH_TEST(path)
+  {
+    auto node = czh::Czh("a: b: c = 1; r = ::a::d; s = c; end; d = \"x\"; end;", czh::InputMode::string).parse();
+    czh::Path c("a::b::c");
+    LIBCZH_EXPECT_EQ(c.size(), 3u);
+    LIBCZH_EXPECT_EQ(c.to_string(), "a::b::c");
+    LIBCZH_EXPECT_TRUE(&node.at(c) == &node["a"]["b"]["c"]);
+    LIBCZH_EXPECT_EQ(node.get<int>(c), 1);
+    LIBCZH_EXPECT_EQ(node["a"].get<std::string>(czh::Path{"b", "r"}), "x");
+    LIBCZH_EXPECT_EQ(node["a"]["b"].get<std::string>(czh::Path("::a::d")), "x");
+    LIBCZH_EXPECT_EQ(node.try_get<int>(czh::Path("a::b::s")).value(), 1);
+    LIBCZH_EXPECT_FALSE(node.try_get<int>(czh::Path("a::b::x")).has_value());
+    LIBCZH_EXPECT_FALSE(node.try_get<int>(czh::Path("a::d")).has_value());
+    LIBCZH_EXPECT_FALSE(node.try_get<int>(czh::Path("a::d::e")).has_value());
+    bool thrown = false;
+    try
+    {
+      czh::Path invalid("a::::b");
+    }
+    catch (czh::error::Error &)
+    {
+      thrown = true;
+    }
+    LIBCZH_EXPECT_TRUE(thrown);
+  }
+  
+  LIBCZH_TEST(path_index)
+  {
+    auto node = czh::Czh("a: b: c = 1; end; d = ::a::b::c; end; e: f = 2; end;", czh::InputMode::string).parse();
+    node.build_index();
+    auto error = [](auto &&f)
+    {
+      try
+      {
+        f();
+      }
+      catch (czh::error::CzhError &)
+      {
+        return true;
+      }
+      return false;
+    };
+    LIBCZH_EXPECT_TRUE(&node.at(czh::Path("a::b::c")) == &node["a"]["b"]["c"]);
+    LIBCZH_EXPECT_EQ(node.get<int>(czh::Path("a::d")), 1);
+    node["a"]["b"].add("g", 3);
+    LIBCZH_EXPECT_EQ(node.get<int>(czh::Path("a::b::g")), 3);
+    node["a"]["b"].rename("B");
+    LIBCZH_EXPECT_EQ(node.get<int>(czh::Path("a::B::g")), 3);
+    LIBCZH_EXPECT_TRUE(error([&node] { node.at(czh::Path("a::b::g")); }));
+    node["a"]["B"].move_to(node["e"]);
+    LIBCZH_EXPECT_EQ(node.get<int>(czh::Path("e::B::c")), 1);
+    LIBCZH_EXPECT_TRUE(error([&node] { node.at(czh::Path("a::B")); }));
+    node["e"]["B"].remove();
+    LIBCZH_EXPECT_TRUE(error([&node] { node.at(czh::Path("e::B::c")); }));
+    node["e"].clear();
+    LIBCZH_EXPECT_TRUE(error([&node] { node.at(czh::Path("e::f")); }));
+    node["e"].add_node("h").add("i", 4);
+    LIBCZH_EXPECT_EQ(node.get<int>(czh::Path("e::h::i")), 4);
+    node["e"] = 5;
+    LIBCZH_EXPECT_FALSE(node.try_get<int>(czh::Path("e::h::i")).has_value());
+    LIBCZH_EXPECT_EQ(node.get<int>(czh::Path("e")), 5);
+    node.drop_index();
+    LIBCZH_EXPECT_EQ(node.get<int>(czh::Path("e")), 5);
+  }
+  
+  LIBCZH_TEST(ref_cache)
+  {
+    auto node = czh::Czh("s: a = 1; end; b: r = s::a; end;", czh::InputMode::string).parse();
+    LIBCZH_EXPECT_EQ(node["b"]["r"].get<int>(), 1);
+    node["b"].add_node("s");
+    LIBCZH_EXPECT_EQ(node["b"]["r"].get<int>(), 1);
+    // A new node is linked like its parent, so adding to it still drops the cached target.
+    node["b"]["s"].add("a", 2);
+    LIBCZH_EXPECT_EQ(node["b"]["r"].get<int>(), 2);
+    node["b"]["s"]["a"].rename("c");
+    LIBCZH_EXPECT_EQ(node["b"]["r"].get<int>(), 1);
+    
+    // A tree which was never linked caches the target on the first read.
+    czh::Node built;
+    built.add("a", 1);
+    built.add_node("b").add("r", value::Reference({"a"}));
+    LIBCZH_EXPECT_EQ(built["b"]["r"].get<int>(), 1);
+    LIBCZH_EXPECT_EQ(built.try_get<int>({"b", "r"}).value_or(0), 1);
+    built["b"].add("a", 3);
+    LIBCZH_EXPECT_EQ(built["b"]["r"].get<int>(), 3);
+    built["b"]["r"] = 4;
+    LIBCZH_EXPECT_EQ(built["b"]["a"].get<int>(), 4);
+    built["b"]["a"].remove();
+    LIBCZH_EXPECT_EQ(built["b"]["r"].get<int>(), 1);
+    built["a"] = value::Reference({"r", "b"});
+    bool circular = false;
+    try
+    {
+      built["b"]["r"].get<int>();
+    }
+    catch (czh::error::CzhError &e)
+    {
+      circular = std::string(e.what()).find("circular") != std::string::npos;
+    }
+    LIBCZH_EXPECT_TRUE(circular);
+  }
+  
+  LIBCZH_TEST(ref_path)
+  {
+    auto node = czh::Czh("a = 1; b: c: d = 2; x = ::a; y = d; z = ::b::c::d; end; w = c::d; end;"
+                         "e: f = b::c::d; g = ::a; end;", czh::InputMode::string).parse();
+    std::ostringstream os;
+    os << node;
+    LIBCZH_EXPECT_EQ(os.str(), "a=1;b:c:d=2;x=a;y=d;z=d;end;w=c::d;end;e:f=b::c::d;g=a;end;");
+    czh::Node copy(node);
+    LIBCZH_EXPECT_TRUE(copy == node);
+    copy["e"]["g"].get_value() = value::Reference({"d", "c", "b"});
+    LIBCZH_EXPECT_FALSE(copy == node);
+    copy["e"]["g"].get_value() = value::Reference({"a"});
+    LIBCZH_EXPECT_TRUE(copy == node);
+  }
+  
+  LIBCZH_TEST(hash)
+  {
+    std::string code = "a = 1; b: c = \"x\"; d = {1, 2, 3}; r = a; end; e: end;";
+    auto node = czh::Czh(code, czh::InputMode::string).parse();
+    auto reloaded = czh::Czh(code, czh::InputMode::string).parse();
+    auto h = node.hash();
+    LIBCZH_EXPECT_EQ(h, reloaded.hash());
+    LIBCZH_EXPECT_EQ(h, std::hash<czh::Node>{}(node));
+    LIBCZH_EXPECT_TRUE(node == reloaded);
+    LIBCZH_EXPECT_EQ(node["b"]["d"].get_value().hash(), std::hash<value::Value>{}(value::Value(value::Array{1, 2, 3})));
+    
+    node["b"]["c"] = "y";
+    LIBCZH_EXPECT_TRUE(node.hash() != h);
+    LIBCZH_EXPECT_FALSE(node == reloaded);
+    node["b"]["c"] = "x";
+    LIBCZH_EXPECT_EQ(node.hash(), h);
+    node["e"].add("f", 2);
+    LIBCZH_EXPECT_TRUE(node.hash() != h);
+    node["e"]["f"].remove();
+    LIBCZH_EXPECT_EQ(node.hash(), h);
+    node["b"].rename("g");
+    LIBCZH_EXPECT_TRUE(node.hash() != h);
+    node["g"].rename("b");
+    LIBCZH_EXPECT_EQ(node.hash(), h);
+    node["b"]["d"].get_value() = value::Array{1, 2};
+    LIBCZH_EXPECT_TRUE(node.hash() != h);
+    node["b"]["d"] = value::Array{1, 2, 3};
+    LIBCZH_EXPECT_EQ(node.hash(), h);
+    node["b"]["c"].move_to(node["e"]);
+    LIBCZH_EXPECT_TRUE(node.hash() != h);
+    node["e"]["c"].move_to(node["b"], "d");
+    LIBCZH_EXPECT_EQ(node.hash(), h);
+    czh::Node copy(node);
+    LIBCZH_EXPECT_EQ(copy.hash(), h);
+    
+    // References are equal if their targets are, so their hashes must be too.
+    auto relative = czh::Czh("x = 1; b: r = x; end;", czh::InputMode::string).parse();
+    auto global = czh::Czh("x = 1; b: r = ::x; end;", czh::InputMode::string).parse();
+    LIBCZH_EXPECT_TRUE(relative == global);
+    LIBCZH_EXPECT_EQ(relative.hash(), global.hash());
+    LIBCZH_EXPECT_TRUE(czh::diff(relative, global).empty());
+    auto to_x = czh::Czh("x = 1; y = 2; b: r = x; end;", czh::InputMode::string).parse();
+    auto to_y = czh::Czh("x = 1; y = 2; b: r = y; end;", czh::InputMode::string).parse();
+    LIBCZH_EXPECT_EQ(to_x.hash(), to_y.hash());
+    LIBCZH_EXPECT_FALSE(to_x == to_y);
+    czh::apply(to_x, czh::diff(to_x, to_y));
+    LIBCZH_EXPECT_EQ(to_x["b"]["r"].get<int>(), 2);
+    
+    // Assigning a descendant destroys it.
+    auto tree = czh::Czh("a: b: c = 1; end; d = 2; end; e = 3;", czh::InputMode::string).parse();
+    auto expected = czh::Czh("a: c = 1; end; e = 3;", czh::InputMode::string).parse();
+    auto tree_hash = tree.hash();
+    auto &a = tree["a"];
+    a = a["b"];
+    LIBCZH_EXPECT_EQ(a.get_name(), "a");
+    LIBCZH_EXPECT_EQ(a["c"].get<int>(), 1);
+    LIBCZH_EXPECT_EQ(a.hash(), expected["a"].hash());
+    LIBCZH_EXPECT_TRUE(tree.hash() != tree_hash);
+    LIBCZH_EXPECT_EQ(tree.hash(), expected.hash());
+    LIBCZH_EXPECT_TRUE(a["c"].get_path() == (std::vector<std::string>{"c", "a"}));
+    LIBCZH_EXPECT_TRUE(a.get_last_node() == &tree);
+    auto root = czh::Czh("a: b: c = 1; end; end;", czh::InputMode::string).parse();
+    root = root["a"]["b"];
+    LIBCZH_EXPECT_TRUE(root.get_last_node() == nullptr);
+    LIBCZH_EXPECT_TRUE(root["c"].get_path() == (std::vector<std::string>{"c"}));
+    // The assigned node keeps its name, so its parent still finds it.
+    auto other = czh::Czh("x: y = 2; end;", czh::InputMode::string).parse();
+    tree["a"] = other["x"];
+    LIBCZH_EXPECT_TRUE(tree.has_node("a"));
+    LIBCZH_EXPECT_FALSE(tree.has_node("x"));
+    LIBCZH_EXPECT_EQ(tree["a"]["y"].get<int>(), 2);
+    LIBCZH_EXPECT_EQ(tree["a"].get_name(), "a");
+  }
+  
+  LIBCZH_TEST(patch)
+  {
+    auto old_config = czh::Czh("base: port = 80; host = \"a\"; end; x: y = 1; z = 2; end;"
+                               "p = base::port; q: w = 3; end; k = 1; m = 2; n = 3;", czh::InputMode::string).parse();
+    auto new_config = czh::Czh("base: port = 8080; host = \"a\"; end; x2: y = 1; z = 2; end;"
+                               "p = ::base::host; added: v = base::port; end; n = 3; k = 1; m = {1, 2};",
+                               czh::InputMode::string).parse();
+    auto patch = czh::diff(old_config, new_config);
+    std::map<czh::Patch::Operation::Kind, int> kinds;
+    for (auto &op: patch) ++kinds[op.kind];
+    using Kind = czh::Patch::Operation::Kind;
+    LIBCZH_EXPECT_EQ(kinds[Kind::remove], 1);
+    LIBCZH_EXPECT_EQ(kinds[Kind::rename], 1);
+    LIBCZH_EXPECT_EQ(kinds[Kind::move], 1);
+    LIBCZH_EXPECT_EQ(kinds[Kind::add], 1);
+    LIBCZH_EXPECT_EQ(kinds[Kind::set], 3);
+    
+    std::ostringstream os;
+    os << patch;
+    auto shipped = czh::Czh(os.str(), czh::InputMode::string).parse_patch();
+    LIBCZH_EXPECT_EQ(shipped.size(), patch.size());
+    czh::Node copy(old_config);
+    czh::apply(old_config, patch);
+    czh::apply(copy, shipped);
+    LIBCZH_EXPECT_TRUE(old_config == new_config);
+    LIBCZH_EXPECT_TRUE(copy == new_config);
+    LIBCZH_EXPECT_EQ(old_config.hash(), new_config.hash());
+    LIBCZH_EXPECT_EQ(old_config["p"].get<std::string>(), "a");
+    LIBCZH_EXPECT_EQ(old_config["added"]["v"].get<int>(), 8080);
+    LIBCZH_EXPECT_TRUE(czh::diff(old_config, new_config).empty());
+    
+    // A name is vacated before a rename reuses it, and a cycle of renames goes through a temporary name.
+    // Renamed Nodes holding References are diffed, as all References hash the same.
+    for (auto [from_code, to_code]: std::vector<std::pair<std::string, std::string>>{
+        {"x = 1; y = 2; a: r = x; end;", "x = 1; y = 2; b: r = y; end;"},
+        {"x = 1; y = 2; r = x;", "x = 1; y = 2; s = y;"},
+        {"a = 1; b: x = 2; end;", "b = 1; c: x = 2; end;"},
+        {"a = 1; b: x = 1; end; c = 3;", "b = 1; c: x = 1; end; d = 3;"},
+        {"a = 1; b: x = 2; end;", "b = 1; a: x = 2; end;"},
+        {"a = 1; b: x = 2; end; czh_rename_0 = 3;", "b = 1; a: x = 2; end; czh_rename_0 = 3;"}})
+    {
+      auto from = czh::Czh(from_code, czh::InputMode::string).parse();
+      auto to = czh::Czh(to_code, czh::InputMode::string).parse();
+      auto renames = czh::diff(from, to);
+      std::ostringstream written;
+      written << renames;
+      czh::Node shipped_from(from);
+      czh::apply(from, renames);
+      czh::apply(shipped_from, czh::Czh(written.str(), czh::InputMode::string).parse_patch());
+      LIBCZH_EXPECT_TRUE(from == to);
+      LIBCZH_EXPECT_TRUE(shipped_from == to);
+    }
+    auto ref_from = czh::Czh("x = 1; y = 2; a: r = x; end;", czh::InputMode::string).parse();
+    auto ref_to = czh::Czh("x = 1; y = 2; b: r = y; end;", czh::InputMode::string).parse();
+    czh::apply(ref_from, czh::diff(ref_from, ref_to));
+    LIBCZH_EXPECT_EQ(ref_from["b"]["r"].get<int>(), 2);
+  }
+  
+  LIBCZH_TEST(overlay)
+  {
+    auto base = czh::Czh("server: port = 80; host = \"a\"; tls: on = false; end; end;"
+                         "log = 1; paths: root = \"/\"; end;", czh::InputMode::string).parse();
+    auto region = czh::Czh("server: tls: on = true; cert = \"r\"; end; end; paths = 2;",
+                           czh::InputMode::string).parse();
+    auto host = czh::Czh("server: port = 8080; extra = 1; end; debug = true;", czh::InputMode::string).parse();
+    czh::Overlay config{base, region};
+    config.push(host);
+    LIBCZH_EXPECT_EQ(config.depth(), 3u);
+    LIBCZH_EXPECT_EQ(config["server"]["port"].get<int>(), 8080);
+    LIBCZH_EXPECT_EQ(config["server"]["host"].get<std::string>(), "a");
+    LIBCZH_EXPECT_EQ(config.get<bool>(czh::Path("server::tls::on")), true);
+    LIBCZH_EXPECT_EQ(config["server"]["tls"]["cert"].get<std::string>(), "r");
+    LIBCZH_EXPECT_EQ(config["paths"].get<int>(), 2);
+    LIBCZH_EXPECT_FALSE(config["paths"].is_node());
+    LIBCZH_EXPECT_TRUE(config.has_node("debug"));
+    LIBCZH_EXPECT_FALSE(config["server"].has_node("cert"));
+    
+    std::vector<std::string> names;
+    for (auto &&r: config["server"]) names.emplace_back(r.get_name());
+    LIBCZH_EXPECT_TRUE(names == (std::vector<std::string>{"port", "host", "tls", "extra"}));
+    names.clear();
+    for (auto &&r: config) names.emplace_back(r.get_name());
+    LIBCZH_EXPECT_TRUE(names == (std::vector<std::string>{"server", "log", "paths", "debug"}));
+    
+    auto flat = czh::Czh("server: port = 8080; host = \"a\"; tls: on = true; cert = \"r\"; end; extra = 1; end;"
+                         "log = 1; paths = 2; debug = true;", czh::InputMode::string).parse();
+    LIBCZH_EXPECT_TRUE(config.flatten() == flat);
+    host["server"]["port"] = 443;
+    LIBCZH_EXPECT_EQ(config.get<int>(czh::Path("server::port")), 443);
+    bool thrown = false;
+    try
+    {
+      auto r = config["server"]["missing"];
+    }
+    catch (czh::error::Error &)
+    {
+      thrown = true;
+    }
+    LIBCZH_EXPECT_TRUE(thrown);
+  }
+  
+  LIBCZH_TEST(view)
+  {
+    auto node = czh::Czh("ports: a = 80; b = 443; c = a; end; names = {\"x\", \"y\"};"
+                         "ints = {1, 2, 3}; mixed = {1, \"2\"}; empty = {}; s = \"str\"; r = s;",
+                         czh::InputMode::string).parse();
+    std::vector<std::pair<std::string, int>> ports;
+    for (auto [name, port]: node["ports"].values<int>()) ports.emplace_back(name, port);
+    LIBCZH_EXPECT_TRUE(ports == (std::vector<std::pair<std::string, int>>{{"a", 80}, {"b", 443}, {"c", 80}}));
+    LIBCZH_EXPECT_EQ(node["ports"].values<int>().size(), 3u);
+    
+    auto ints = node["ints"].view<std::span<const int>>();
+    LIBCZH_EXPECT_EQ(ints.size(), 3u);
+    LIBCZH_EXPECT_EQ(ints[2], 3);
+    LIBCZH_EXPECT_TRUE(ints.data() == node["ints"].view<std::span<const int>>().data());
+    LIBCZH_EXPECT_EQ(node["names"].view<std::span<const std::string>>()[1], "y");
+    LIBCZH_EXPECT_TRUE(node["empty"].view<std::span<const double>>().empty());
+    LIBCZH_EXPECT_TRUE(&node["r"].view<std::string>() == &node["s"].view<std::string>());
+    
+    int errors = 0;
+    for (auto f: {+[](czh::Node &n) { (void) n["mixed"].view<std::span<const int>>(); },
+                  +[](czh::Node &n) { (void) n["ints"].view<std::span<const double>>(); },
+                  +[](czh::Node &n) { (void) n["s"].view<int>(); }})
+    {
+      try
+      {
+        f(node);
+      }
+      catch (czh::error::Error &)
+      {
+        ++errors;
+      }
+    }
+    LIBCZH_EXPECT_EQ(errors, 3);
+    
+    // A parsed Array is packed, so it can only be viewed as a span.
+    auto &parsed = node["ints"];
+    auto viewable = [](auto &n)
+    {
+      return requires { n.template view<czh::value::Array>(); }
+             || requires { n.template get_unchecked<czh::value::Array>(); }
+             || requires { n.get_value().template view<czh::value::Array>(); };
+    };
+    LIBCZH_EXPECT_FALSE(viewable(parsed));
+    LIBCZH_EXPECT_EQ(parsed.view<std::span<const int>>()[0], 1);
+    LIBCZH_EXPECT_EQ(parsed.get<czh::value::Array>().size(), 3u);
+  }
+  
+  LIBCZH_TEST(reserve)
+  {
+    czh::Node node;
+    node.reserve(100);
+    node.add("a", 1);
+    node.add("b", 2);
+    node.add("c", 3, "a");
+    LIBCZH_EXPECT_EQ(node["b"].get<int>(), 2);
+    LIBCZH_EXPECT_EQ(node.cbegin()->get_name(), "c");
+    node["a"].remove();
+    node["b"].rename("d");
+    LIBCZH_EXPECT_FALSE(node.has_node("a"));
+    LIBCZH_EXPECT_EQ(node["d"].get<int>(), 2);
+    for (int i = 0; i < 1000; ++i) node.add("k" + std::to_string(i), i);
+    for (int i = 0; i < 1000; ++i) LIBCZH_EXPECT_EQ(node["k" + std::to_string(i)].get<int>(), i);
+    LIBCZH_EXPECT_FALSE(node.has_node("k1000"));
+    
+    czh::Node other;
+    other.add("x", 1);
+    other.add("y", 2);
+    node.reserve(2000).splice(std::move(other));
+    LIBCZH_EXPECT_EQ(node["y"].get<int>(), 2);
+    czh::Node copy(node);
+    LIBCZH_EXPECT_TRUE(copy == node);
+    LIBCZH_EXPECT_EQ(copy["k999"].get<int>(), 999);
+  }
+  
+  LIBCZH_TEST(unchecked)
+  {
+    auto node = czh::Czh("a: b = 1; s = \"x\"; r = b; end; c = a::b; arr = {1, \"2\"}; ints = {1, 2};",
+                         czh::InputMode::string).parse();
+    auto a = node.find("a");
+    LIBCZH_EXPECT_TRUE(a != nullptr && a->find("b") != nullptr);
+    LIBCZH_EXPECT_TRUE(node.find("x") == nullptr);
+    LIBCZH_EXPECT_TRUE(node["c"].find("x") == nullptr);
+    LIBCZH_EXPECT_TRUE(node.find(czh::Path("a::r")) == &node["a"]["r"]);
+    LIBCZH_EXPECT_TRUE(node.find(czh::Path("a::b::c")) == nullptr);
+    
+    LIBCZH_EXPECT_EQ(node["c"].try_get<int>().value(), 1);
+    LIBCZH_EXPECT_FALSE(node["a"]["s"].try_get<int>().has_value());
+    LIBCZH_EXPECT_FALSE(node["a"].try_get<int>().has_value());
+    LIBCZH_EXPECT_FALSE(node["arr"].try_get<std::vector<int>>().has_value());
+    LIBCZH_EXPECT_EQ(node["ints"].try_get<std::vector<int>>().value().size(), 2u);
+    LIBCZH_EXPECT_EQ(node["a"]["r"].get_unchecked<int>(), 1);
+    LIBCZH_EXPECT_EQ(node["a"]["s"].get_unchecked<std::string>(), "x");
+    
+    node["a"]["b"].remove();
+    LIBCZH_EXPECT_FALSE(node["c"].try_get<int>().has_value());
+    LIBCZH_EXPECT_FALSE(node.try_get<int>(czh::Path("a::r")).has_value());
+    node["a"].add("b", czh::value::Reference({"r"}));
+    LIBCZH_EXPECT_FALSE(node["c"].try_get<int>().has_value());
+    LIBCZH_EXPECT_TRUE(node["c"].try_get<czh::value::Reference>().has_value());
+  }
 }
\ No newline at end of file